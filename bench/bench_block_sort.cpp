@@ -0,0 +1,34 @@
+#include "benchmark.h"
+#include "block_sort.h"
+#include "huffman.h"
+#include <iostream>
+#include <iomanip>
+
+namespace {
+    void measure(const std::string& name, Compressor& comp, const std::vector<uint8_t>& data) {
+        auto start = std::chrono::steady_clock::now();
+        auto encoded = comp.compress(data);
+        double compress_seconds = elapsedSeconds(start);
+
+        std::vector<uint8_t> out(data.size());
+        start = std::chrono::steady_clock::now();
+        comp.decompress(encoded.bits, encoded.padding, out);
+        double decompress_seconds = elapsedSeconds(start);
+
+        std::cout << std::left << std::setw(18) << name << std::right << std::fixed << std::setprecision(3)
+                  << " ratio " << static_cast<double>(encoded.bits.size()) / data.size()
+                  << std::setprecision(1) << "  compress " << megabytesPerSecond(data.size(), compress_seconds)
+                  << " MB/s  decompress " << megabytesPerSecond(data.size(), decompress_seconds) << " MB/s"
+                  << std::endl;
+    }
+}
+
+// single chunk ratio and speed of plain Huffman against BWT + MTF + Huffman
+BENCHMARK(BlockSortRatio) {
+    auto data = benchmarkData(BlockSort::kBlockSize);
+
+    Huffman plain;
+    BlockSort block_sort(std::make_unique<Huffman>());
+    measure("huffman", plain, data);
+    measure("bwt+mtf+huffman", block_sort, data);
+}
@@ -0,0 +1,57 @@
+#include "benchmark.h"
+#include "threaded_compressor.h"
+#include <iostream>
+#include <iomanip>
+
+// per-call latency of the inline in-memory path for small payloads
+BENCHMARK(SmallBufferLatency) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 64 * 1024);
+
+    for (size_t size : {256, 1024, 4096, 16384}) {
+        auto data = benchmarkData(size);
+        auto archive = tc.compress(data);
+        const size_t iterations = 20000;
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i=0; i<iterations; ++i) {
+            archive = tc.compress(data);
+        }
+        double compress_us = elapsedSeconds(start) * 1e6 / iterations;
+
+        start = std::chrono::steady_clock::now();
+        for (size_t i=0; i<iterations; ++i) {
+            data = tc.decompress(archive);
+        }
+        double decompress_us = elapsedSeconds(start) * 1e6 / iterations;
+
+        std::cout << std::setw(6) << size << " B  compress " << std::fixed << std::setprecision(2)
+                  << compress_us << " us  decompress " << decompress_us << " us  ratio "
+                  << static_cast<double>(archive.size()) / size << std::endl;
+    }
+}
+
+// thousands of small payloads as one job across the pool
+BENCHMARK(SmallBufferBatch) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 64 * 1024);
+
+    std::vector<std::vector<uint8_t>> buffers;
+    size_t total = 0;
+    for (size_t i=0; i<10000; ++i) {
+        buffers.push_back(benchmarkData(1024));
+        total += 1024;
+    }
+    std::vector<std::span<const uint8_t>> inputs(buffers.begin(), buffers.end());
+
+    auto start = std::chrono::steady_clock::now();
+    auto archives = tc.compressBatch(inputs);
+    double seconds = elapsedSeconds(start);
+    std::cout << "compressBatch   " << inputs.size() << " x 1 KiB  " << std::fixed << std::setprecision(2)
+              << seconds * 1e6 / inputs.size() << " us/buffer  " << megabytesPerSecond(total, seconds) << " MB/s" << std::endl;
+
+    std::vector<std::span<const uint8_t>> views(archives.begin(), archives.end());
+    start = std::chrono::steady_clock::now();
+    auto restored = tc.decompressBatch(views);
+    seconds = elapsedSeconds(start);
+    std::cout << "decompressBatch " << views.size() << " x 1 KiB  " << seconds * 1e6 / views.size()
+              << " us/buffer  " << megabytesPerSecond(total, seconds) << " MB/s" << std::endl;
+}
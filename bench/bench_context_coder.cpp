@@ -0,0 +1,59 @@
+#include "benchmark.h"
+#include "huffman.h"
+#include <iostream>
+#include <iomanip>
+#include <string>
+
+namespace {
+    std::vector<uint8_t> csvData(size_t size) {
+        std::string text = "id,timestamp,status,latency_ms\n";
+        uint32_t state = 777;
+        const char* statuses[] = {"OK", "TIMEOUT", "RETRY", "ERROR"};
+        for (size_t row=0; text.size() < size; ++row) {
+            state = state * 1103515245 + 12345;
+            text += std::to_string(100000 + row) + ",2024-05-" + std::to_string(10 + (state >> 8) % 20) + "T"
+                  + std::to_string(10 + (state >> 12) % 14) + ":" + std::to_string(10 + (state >> 16) % 50)
+                  + "Z," + statuses[(state >> 20) % 4] + "," + std::to_string((state >> 4) % 900) + "\n";
+        }
+        return std::vector<uint8_t>(text.begin(), text.begin() + size);
+    }
+
+    void measure(const std::string& name, const std::vector<uint8_t>& data, size_t tables) {
+        Huffman h;
+        h.setContextTables(tables);
+        const int rounds = 5;
+
+        Compressor::EncodedData encoded;
+        auto start = std::chrono::steady_clock::now();
+        for (int i=0; i<rounds; ++i) {
+            encoded = h.compress(data);
+        }
+        double encode_seconds = elapsedSeconds(start);
+
+        std::vector<uint8_t> out(data.size());
+        start = std::chrono::steady_clock::now();
+        for (int i=0; i<rounds; ++i) {
+            h.decompress(encoded.bits, encoded.padding, out);
+        }
+        double decode_seconds = elapsedSeconds(start);
+
+        std::cout << std::left << std::setw(5) << name << std::right << std::setw(3) << tables << " tables"
+                  << std::fixed << std::setprecision(3) << "  ratio " << static_cast<double>(encoded.bits.size()) / data.size()
+                  << std::setprecision(1) << "  encode " << megabytesPerSecond(data.size() * rounds, encode_seconds)
+                  << " MB/s  decode " << megabytesPerSecond(data.size() * rounds, decode_seconds) << " MB/s" << std::endl;
+    }
+}
+
+// ratio gained by previous-byte tables against what they cost in encode and decode speed
+BENCHMARK(ContextTables) {
+    const size_t chunk = 1024 * 1024;
+    auto csv = csvData(chunk);
+    auto json = benchmarkData(chunk);
+
+    for (size_t tables : {1, 4, 16}) {
+        measure("csv", csv, tables);
+    }
+    for (size_t tables : {1, 4, 16}) {
+        measure("json", json, tables);
+    }
+}
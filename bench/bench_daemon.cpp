@@ -0,0 +1,42 @@
+#include "benchmark.h"
+#include "compression_daemon.h"
+#include <iostream>
+#include <iomanip>
+#include <unistd.h>
+
+// per-job cost of a cold compressor against a request to a warm daemon
+BENCHMARK(DaemonLatency) {
+    std::string path = "/tmp/mtc-bench-" + std::to_string(getpid()) + ".sock";
+    ThreadedCompressor warm(std::make_unique<Huffman>(), ThreadedCompressor::kAuto);
+    warm.setLog(nullptr);
+    CompressionDaemon daemon(warm, path);
+    DaemonClient client(path);
+
+    for (size_t size : {4096, 65536, 1024 * 1024}) {
+        auto data = benchmarkData(size);
+        const size_t iterations = size > 65536 ? 50 : 1000;
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i=0; i<iterations; ++i) {
+            ThreadedCompressor cold(std::make_unique<Huffman>(), ThreadedCompressor::kAuto);
+            cold.setLog(nullptr);
+            cold.compress(data);
+        }
+        double cold_us = elapsedSeconds(start) * 1e6 / iterations;
+
+        start = std::chrono::steady_clock::now();
+        for (size_t i=0; i<iterations; ++i) {
+            client.compress(data);
+        }
+        double daemon_us = elapsedSeconds(start) * 1e6 / iterations;
+
+        start = std::chrono::steady_clock::now();
+        for (size_t i=0; i<iterations; ++i) {
+            DaemonClient(path).compress(data);
+        }
+        double connect_us = elapsedSeconds(start) * 1e6 / iterations;
+
+        std::cout << std::setw(8) << size << " B  cold pool " << std::fixed << std::setprecision(1) << cold_us
+                  << " us  daemon " << daemon_us << " us  daemon with connect " << connect_us << " us" << std::endl;
+    }
+}
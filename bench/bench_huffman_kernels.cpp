@@ -0,0 +1,73 @@
+#include "benchmark.h"
+#include "huffman.h"
+#include "huffman_kernels.h"
+#include <iostream>
+#include <iomanip>
+
+namespace {
+    void measure(const char* name, const std::vector<uint8_t>& data) {
+        Huffman h;
+        h.buildFrequencyTable(data);
+        h.buildHuffmanTree();
+        std::string path;
+        h.generateCodes(h.getRoot(), path);
+        std::vector<uint8_t> tree;
+        h.serializeTree(h.getRoot(), tree);
+        Huffman coder;
+        coder.loadTree(tree);
+
+        std::array<HuffmanCode, 256> codes{};
+        unsigned int max_length = 0;
+        for (const auto& [byte, code] : coder.getHuffmanCodes()) {
+            for (char bit : code) {
+                codes[byte].bits = (codes[byte].bits << 1) | (bit=='1');
+            }
+            codes[byte].length = static_cast<uint8_t>(code.size());
+            max_length = std::max<unsigned int>(max_length, code.size());
+        }
+        HuffmanDecodeTable table = coder.getDecodeTable();
+
+        const int rounds = 5;
+        for (auto isa : {HuffmanKernels::Isa::Scalar, HuffmanKernels::Isa::Bmi2}) {
+            if (!HuffmanKernels::supported(isa)) continue;
+
+            std::vector<uint8_t> bits((data.size() * max_length + 7) / 8);
+            uint8_t padding = 0;
+            size_t written = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (int i=0; i<rounds; ++i) {
+                written = HuffmanKernels::encode(data, codes, max_length, bits, padding, isa);
+            }
+            double encode_seconds = elapsedSeconds(start);
+            bits.resize(written);
+
+            std::vector<uint8_t> out(data.size());
+            start = std::chrono::steady_clock::now();
+            for (int i=0; i<rounds; ++i) {
+                HuffmanKernels::decode(bits, padding, table, out, isa);
+            }
+            double decode_seconds = elapsedSeconds(start);
+
+            std::cout << std::left << std::setw(7) << name << std::setw(7)
+                      << (isa==HuffmanKernels::Isa::Scalar ? "scalar" : "bmi2") << std::right
+                      << " longest code " << std::setw(2) << max_length << std::fixed << std::setprecision(1)
+                      << "  encode " << megabytesPerSecond(data.size() * rounds, encode_seconds)
+                      << " MB/s  decode " << megabytesPerSecond(data.size() * rounds, decode_seconds) << " MB/s"
+                      << std::endl;
+        }
+    }
+}
+
+// raw bit loop throughput of every instruction set variant, table headers not included
+BENCHMARK(HuffmanKernels) {
+    auto text = benchmarkData(8 * 1024 * 1024);
+    measure("text", text);
+
+    std::vector<uint8_t> skewed(text.size());
+    uint32_t state = 99;
+    for (auto& byte : skewed) {
+        state = state * 1103515245 + 12345;
+        byte = static_cast<uint8_t>(__builtin_ctz((state >> 8) | 0x800000));   // mostly zeros
+    }
+    measure("skewed", skewed);
+}
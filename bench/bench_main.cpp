@@ -0,0 +1,42 @@
+#include "benchmark.h"
+#include <iostream>
+
+std::vector<Benchmark>& benchmarks() {
+    static std::vector<Benchmark> registry;
+    return registry;
+}
+
+std::vector<uint8_t> benchmarkData(size_t size) {
+    static const std::string words[] = {
+        "the ", "quick ", "brown ", "fox ", "jumps ", "over ", "lazy ", "dog ",
+        "{\"id\":", "\"name\":", "\"value\":", "},\n", "1,", "42,", "3.14,", "true,",
+    };
+    std::vector<uint8_t> data;
+    data.reserve(size);
+    uint32_t state = 12345;
+    while (data.size() < size) {
+        state = state * 1103515245 + 12345;
+        const std::string& word = words[(state >> 16) % 16];
+        data.insert(data.end(), word.begin(), word.end());
+    }
+    data.resize(size);
+    return data;
+}
+
+double elapsedSeconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    for (const auto& benchmark : benchmarks()) {
+        bool selected = argc < 2;
+        for (int i=1; i<argc; ++i) {
+            selected |= benchmark.name==argv[i];
+        }
+        if (!selected) continue;
+
+        std::cout << "== " << benchmark.name << std::endl;
+        benchmark.run();
+    }
+    return 0;
+}
@@ -0,0 +1,44 @@
+#include "benchmark.h"
+#include "threaded_compressor.h"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+
+namespace {
+    double streamThroughput(const std::string& input, size_t threads, ThreadedCompressor::Placement placement) {
+        ThreadedCompressor tc(std::make_unique<Huffman>(), 1024 * 1024, threads, placement);
+
+        // one warm-up pass fills the buffer pools
+        for (int pass=0; pass<2; ++pass) {
+            std::istringstream stream(input);
+            auto start = std::chrono::steady_clock::now();
+            tc.compressStream(stream, [](const Compressor::EncodedData&) {});
+            if (pass==1) {
+                return megabytesPerSecond(input.size(), elapsedSeconds(start));
+            }
+        }
+        return 0;
+    }
+}
+
+// scaling of floating vs NUMA pinned workers as the thread count doubles
+BENCHMARK(NumaScaling) {
+    auto data = benchmarkData(64 * 1024 * 1024);
+    std::string input(data.begin(), data.end());
+
+    auto topology = NumaTopology::detect();
+    size_t cpus = 0;
+    for (const auto& node : topology.getNodes()) {
+        cpus += node.cpus.size();
+    }
+    std::cout << "nodes=" << topology.getNodes().size() << " cpus=" << cpus
+              << " libnuma=" << (NumaTopology::hasLibnuma() ? "yes" : "no") << std::endl;
+    std::cout << std::setw(8) << "threads" << std::setw(14) << "floating MB/s" << std::setw(14) << "pinned MB/s" << std::endl;
+
+    for (size_t threads=1; threads<=cpus; threads*=2) {
+        double floating = streamThroughput(input, threads, ThreadedCompressor::Placement::Floating);
+        double pinned = streamThroughput(input, threads, ThreadedCompressor::Placement::NumaPinned);
+        std::cout << std::setw(8) << threads << std::fixed << std::setprecision(1)
+                  << std::setw(14) << floating << std::setw(14) << pinned << std::endl;
+    }
+}
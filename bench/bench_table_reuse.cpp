@@ -0,0 +1,62 @@
+#include "benchmark.h"
+#include "huffman.h"
+#include <iostream>
+#include <iomanip>
+#include <string>
+
+namespace {
+    void measure(const std::vector<uint8_t>& data, size_t chunk, double penalty) {
+        Huffman h;
+        if (penalty >= 0) {
+            h.setTableReuse(penalty);
+        }
+        const int rounds = 5;
+
+        std::vector<Compressor::EncodedData> encoded;
+        auto start = std::chrono::steady_clock::now();
+        for (int i=0; i<rounds; ++i) {
+            h.resetStream();
+            encoded.clear();
+            for (size_t offset=0; offset<data.size(); offset+=chunk) {
+                auto end = data.begin() + std::min(data.size(), offset + chunk);
+                encoded.push_back(h.compress(std::vector<uint8_t>(data.begin() + offset, end)));
+            }
+        }
+        double encode_seconds = elapsedSeconds(start);
+
+        size_t bytes = 0;
+        size_t repeats = 0;
+        for (const auto& e : encoded) {
+            bytes += e.bits.size();
+            repeats += e.bits[0]==Huffman::RepeatTable;
+        }
+
+        std::vector<uint8_t> out(chunk);
+        start = std::chrono::steady_clock::now();
+        for (int i=0; i<rounds; ++i) {
+            h.resetStream();
+            for (size_t c=0; c<encoded.size(); ++c) {
+                size_t size = std::min(chunk, data.size() - c * chunk);
+                h.decompress(encoded[c].bits, encoded[c].padding, std::span<uint8_t>(out).subspan(0, size));
+            }
+        }
+        double decode_seconds = elapsedSeconds(start);
+
+        std::cout << std::setw(6) << chunk / 1024 << " KiB chunks  "
+                  << (penalty < 0 ? "no reuse  " : "reuse " + std::to_string(static_cast<int>(penalty * 100)) + "% ")
+                  << std::fixed << std::setprecision(4) << "  ratio " << static_cast<double>(bytes) / data.size()
+                  << "  repeats " << repeats << "/" << encoded.size()
+                  << std::setprecision(1) << "  encode " << megabytesPerSecond(data.size() * rounds, encode_seconds)
+                  << " MB/s  decode " << megabytesPerSecond(data.size() * rounds, decode_seconds) << " MB/s" << std::endl;
+    }
+}
+
+// header bytes and tree building saved on uniform data by repeating the previous table
+BENCHMARK(TableReuse) {
+    auto data = benchmarkData(16 * 1024 * 1024);
+    for (size_t chunk : {16 * 1024, 256 * 1024}) {
+        for (double penalty : {-1.0, 0.0, 0.02}) {
+            measure(data, chunk, penalty);
+        }
+    }
+}
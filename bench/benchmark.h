@@ -0,0 +1,35 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// minimal registry so every bench_*.cpp file can add its own benchmarks
+struct Benchmark {
+    std::string name;
+    void (*run)();
+};
+
+std::vector<Benchmark>& benchmarks();
+
+struct RegisterBenchmark {
+    RegisterBenchmark(const std::string& name, void (*run)()) {
+        benchmarks().push_back({name, run});
+    }
+};
+
+#define BENCHMARK(name) \
+    static void name(); \
+    static RegisterBenchmark name##_registration(#name, name); \
+    static void name()
+
+// deterministic text-like data, so runs are comparable
+std::vector<uint8_t> benchmarkData(size_t size);
+
+// seconds since start
+double elapsedSeconds(std::chrono::steady_clock::time_point start);
+
+inline double megabytesPerSecond(size_t bytes, double seconds) {
+    return bytes / (1024.0 * 1024.0) / seconds;
+}
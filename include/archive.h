@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include <span>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+
+// Container for compressed chunks: payloads back to back, then an index of every chunk,
+// then a fixed size footer that locates the index from the end of the archive.
+//
+//   payloads | varint count | per chunk: varint size, varint original size, padding | u64 index offset | "MTCA"
+class Archive {
+    public:
+
+    struct Entry {
+        uint64_t offset;            // of the payload from the start of the archive
+        uint64_t compressed_size;
+        uint64_t original_size;
+        uint8_t padding;
+    };
+
+    static constexpr size_t kFooterSize = 12;
+    static constexpr size_t kMaxEntrySize = 10 + 10 + 1;
+
+    // parses and validates the index of a complete archive
+    static std::vector<Entry> readIndex(std::span<const uint8_t> archive);
+
+    // index offset stored in the last kFooterSize bytes of an archive
+    static uint64_t readFooter(std::span<const uint8_t> footer);
+
+    // parses an index without its footer, for readers that only load the tail of an archive
+    static std::vector<Entry> parseIndex(std::span<const uint8_t> index, uint64_t index_offset);
+
+    // appends the index and footer for entries whose payloads end at index_offset
+    static void writeIndex(const std::vector<Entry>& entries, uint64_t index_offset, std::vector<uint8_t>& out);
+
+    // throws when the sizes do not add up within size_t
+    static uint64_t originalSize(const std::vector<Entry>& entries);
+};
+
+// builds an archive in one output buffer, compressors can encode straight into it
+class ArchiveWriter {
+    public:
+
+    // the archive starts at the current end of out
+    explicit ArchiveWriter(std::vector<uint8_t>& out)
+    : out(out), start(out.size()) {
+
+    };
+
+    // continues an archive whose chunks are entries and whose payloads end at payload_end;
+    // out receives what follows them, new payloads and then the rewritten index
+    ArchiveWriter(std::vector<uint8_t>& out, std::vector<Archive::Entry> entries, uint64_t payload_end)
+    : out(out), start(out.size()), base(payload_end), entries(std::move(entries)) {
+
+    };
+
+    // copies an already compressed chunk into the archive
+    void add(std::span<const uint8_t> bits, uint8_t padding, size_t original_size);
+
+    // space for a chunk of at most size bytes, followed by commit with the bytes actually used
+    std::span<uint8_t> reserve(size_t size);
+    void commit(size_t written, uint8_t padding, size_t original_size);
+
+    // writes index and footer, the archive is complete afterwards
+    void finish();
+
+    private:
+
+    std::vector<uint8_t>& out;
+    size_t start;
+    uint64_t base = 0;   // archive offset of out[start]
+    std::vector<Archive::Entry> entries;
+    size_t reserved_at = 0;
+};
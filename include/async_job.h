@@ -0,0 +1,108 @@
+#pragma once
+
+#include <vector>
+#include <span>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <coroutine>
+
+#include "compressor.h"
+#include "archive.h"
+
+// Handle to a compression job running on a ThreadedCompressor's worker pool. The caller
+// never blocks: completion is observed through a callback, by co_await-ing the job, or
+// by polling isDone(). get() is there for callers that do want to wait.
+class AsyncJob {
+    public:
+
+    struct Progress {
+        size_t chunks_done = 0;
+        size_t chunks_total = 0;
+        size_t bytes_done = 0;    // input bytes of the finished chunks
+        size_t bytes_total = 0;
+    };
+
+    // both run on a worker thread, one at a time per job (on the submitting thread when
+    // there is nothing to schedule: empty input or an unreadable archive); keep them short
+    // or post to your own event loop. on_complete takes the output (empty on error), so get() and
+    // co_await of a job with a completion callback return an empty vector. An exception thrown
+    // by on_complete becomes the job's error unless the job already failed.
+    using ProgressCallback = std::function<void(const Progress&)>;
+    using Completion = std::function<void(std::vector<uint8_t>&& output, std::exception_ptr error)>;
+
+    struct Options {
+        ProgressCallback on_progress;
+        Completion on_complete;
+    };
+
+    // stops submitting chunks; the job completes with std::errc::operation_canceled once
+    // the chunks already running finish. No effect on a job that already completed.
+    void cancel();
+
+    bool isDone() const;
+    Progress getProgress() const;
+
+    // blocks until the job completes, then returns its output or rethrows its error;
+    // the output is moved out, so call at most once (same for co_await)
+    std::vector<uint8_t> get();
+
+    // awaitable, the coroutine resumes on the worker thread that finished the job
+    bool await_ready() const;
+    bool await_suspend(std::coroutine_handle<> continuation);
+    std::vector<uint8_t> await_resume();
+
+    private:
+
+    friend class ThreadedCompressor;
+
+    struct State {
+        bool decompress = false;
+        std::vector<uint8_t> input;                   // owned, chunks view into it
+        std::vector<std::span<const uint8_t>> chunks;
+        std::vector<size_t> runs;                     // first chunk of every task
+        std::vector<Archive::Entry> entries;          // chunk sizes when decompressing
+        std::vector<Compressor::EncodedData> encoded; // per chunk when compressing
+        std::vector<uint8_t> decoded;                 // chunks decode straight into their targets
+        std::vector<std::span<uint8_t>> targets;
+        std::vector<uint8_t> output;
+        Options options;
+
+        std::atomic<bool> cancelled{false};
+        std::atomic<size_t> chunks_done{0};
+        std::atomic<size_t> bytes_done{0};
+        size_t bytes_total = 0;
+
+        // scheduling, guarded by mutex
+        std::mutex mutex;
+        std::condition_variable cv;
+        size_t next_run = 0;
+        size_t in_flight = 0;
+        bool completing = false;
+        bool done = false;
+        std::exception_ptr error;
+        std::coroutine_handle<> continuation;
+
+        std::mutex callback_mutex;   // serializes progress callbacks
+
+        // records the chunk in the progress counters and reports it
+        void chunkFinished(size_t input_size);
+
+        // publishes the output or the error and wakes every kind of waiter, once
+        void complete(std::vector<uint8_t>&& result, std::exception_ptr failure);
+    };
+
+    explicit AsyncJob(std::shared_ptr<State> state)
+    : state(std::move(state)) {
+
+    };
+
+    std::vector<uint8_t> takeResult();
+
+    std::shared_ptr<State> state;
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <cstddef>
+
+// picks chunk size and parallelism for a job, then steers the chunk size from measured encode times
+class AutoTuner {
+    public:
+
+    struct MachineInfo {
+        size_t cores;
+        size_t l2_cache_bytes;
+        size_t l3_cache_bytes;
+
+        // queries the running machine, falling back to common sizes when the OS does not say
+        static MachineInfo detect();
+    };
+
+    // smaller chunks drown in per-chunk table headers, larger ones overflow the
+    // 32-bit symbol counts and starve cores at the tail of a job
+    static constexpr size_t kMinChunkSize = 64 * 1024;
+    static constexpr size_t kMaxChunkSize = 64 * 1024 * 1024;
+
+    // per-chunk encode time the tuner steers towards
+    static constexpr std::chrono::microseconds kMinChunkTime{1000};
+    static constexpr std::chrono::microseconds kMaxChunkTime{20000};
+
+    // input_size of 0 means unknown, e.g. a stream
+    AutoTuner(size_t input_size, size_t workers, const MachineInfo& machine);
+
+    // feeds back one finished chunk; queue_depth is the number of chunks still waiting for a worker
+    void record(size_t chunk_bytes, std::chrono::nanoseconds encode_time, size_t queue_depth);
+
+    // getters
+    size_t getChunkSize() const;
+    size_t getThreadCount() const;
+    size_t getWindow() const;
+    size_t getAdjustments() const;
+
+    // one line summary of the current parameters for logs
+    std::string describe() const;
+
+    private:
+
+    size_t chunk_size;
+    size_t thread_count;
+    size_t chunk_cap;
+    size_t growth_cap;
+    size_t adjustments = 0;
+
+    // samples collected since the last adjustment
+    size_t samples = 0;
+    double sample_ns_per_byte = 0;
+    size_t sample_min_depth = 0;
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "compressor.h"
+#include <vector>
+#include <array>
+#include <span>
+#include <memory>
+
+// Block-sorting stage in front of an entropy coder: Burrows-Wheeler transform per block,
+// then move-to-front ranks with runs of zero ranks folded into run-length symbols, so
+// an order-0 coder behind it sees the skewed distribution text turns into.
+//
+//   Raw:         0 | entropy coded chunk
+//   Transformed: 1 | u32 size | u32 ranks size | u32 primary index per block | entropy coded ranks
+class BlockSort : public Compressor {
+    public:
+
+    enum Format : uint8_t {
+        Raw = 0,           // the transform did not shrink the chunk
+        Transformed = 1,
+    };
+
+    // suffix sorting memory and the u32 link packing of the inverse both scale with the block
+    static constexpr size_t kBlockSize = 1 << 20;
+
+    explicit BlockSort(std::unique_ptr<Compressor> entropy_coder);
+
+    virtual EncodedData compress(const std::vector<uint8_t>& chunk) override;
+    virtual std::vector<uint8_t> decompress(const EncodedData& chunk) override;
+    virtual size_t compressBound(size_t n) const override;
+    virtual size_t compress(std::span<const uint8_t> chunk, std::span<uint8_t> out, uint8_t& padding) override;
+    virtual size_t decompress(std::span<const uint8_t> bits, uint8_t padding, std::span<uint8_t> out) override;
+    virtual size_t decompressBound(std::span<const uint8_t> bits) const override;
+    virtual void resetStream() override;
+    virtual bool standsAlone(std::span<const uint8_t> bits) const override;
+    virtual std::unique_ptr<Compressor> clone() const override;
+
+    // Burrows-Wheeler transform of a block (with an implicit end marker) into out, which has
+    // the block's size; returns the primary index, the row the end marker was dropped from
+    static uint32_t transform(std::span<const uint8_t> block, std::span<uint8_t> out, std::vector<int32_t>& scratch);
+
+    // undoes transform, out has the block's size
+    static void inverseTransform(std::span<const uint8_t> bwt, uint32_t primary, std::span<uint8_t> out,
+                                 std::vector<uint32_t>& scratch);
+
+    // move-to-front ranks, zero runs as bijective base 2 digits 0 and 1, rank r > 0 as r + 1
+    // with 254 and 255 escaped behind 255
+    static void encodeRanks(std::span<const uint8_t> data, std::vector<uint8_t>& out);
+
+    // undoes encodeRanks, throws unless the ranks decode to exactly out.size() bytes
+    static void decodeRanks(std::span<const uint8_t> ranks, std::span<uint8_t> out);
+
+    private:
+
+    static constexpr size_t kHeaderSize = 1 + 4 + 4;
+
+    std::unique_ptr<Compressor> entropy_coder;
+
+    // reused across chunks, every worker has its own clone
+    std::vector<int32_t> suffix_scratch;
+    std::vector<uint32_t> link_scratch;
+    std::vector<uint8_t> bwt;
+    std::vector<uint8_t> ranks;
+};
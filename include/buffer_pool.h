@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <atomic>
+
+// recycles byte buffers so steady-state compression does not touch the heap
+class BufferPool {
+    public:
+
+    // node >= 0 places new buffers on that NUMA node, see NumaTopology::bindMemory
+    explicit BufferPool(int node = -1)
+    : node(node) {
+
+    };
+
+    // returns a buffer resized to size, reusing a released one when it is large enough
+    std::vector<uint8_t> acquire(size_t size);
+
+    // hands a buffer back for reuse, its capacity is kept
+    void release(std::vector<uint8_t>&& buffer);
+
+    // number of times acquire had to go to the heap
+    size_t getAllocations() const;
+
+    private:
+
+    int node;
+    std::mutex mutex;
+    std::vector<std::vector<uint8_t>> free_buffers;
+    std::atomic<size_t> allocations{0};
+};
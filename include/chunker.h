@@ -2,6 +2,8 @@
 
 #include <vector>
 #include <cstdint>
+#include <cstddef>
+#include <span>
 
 class Chunker {
     public:
@@ -20,6 +22,9 @@ class Chunker {
     // splits original file into chunks for paralleled compression
     std::vector<Chunk> split(const std::vector<uint8_t>& input);
 
+    // same boundaries as split, but views into input instead of copies
+    std::vector<std::span<const uint8_t>> view(std::span<const uint8_t> input) const;
+
     private:
     size_t chunk_size;
 };
\ No newline at end of file
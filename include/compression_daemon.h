@@ -0,0 +1,136 @@
+#pragma once
+
+#include "threaded_compressor.h"
+#include <vector>
+#include <string>
+#include <span>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <set>
+#include <deque>
+#include <chrono>
+#include <cstdint>
+
+// Serves compress and decompress requests from other processes over a Unix domain socket,
+// so short-lived callers share one warm worker pool instead of starting threads, building
+// tables and faulting in buffers on every call. Data never goes through the socket, a
+// request passes descriptors to read the input from and write the output to (files, pipes
+// or memfds), and small inputs are served inline on the handler thread. Only sealed
+// memfds are mapped, other inputs are copied.
+//
+// One thread polls the socket and every idle connection, a fixed set of handler threads
+// serves the requests that arrive, so idle connections hold no thread. A request's I/O on
+// client descriptors gives up at its timeout or when the daemon stops.
+//
+//   request: u8 op, with an input and an output descriptor as SCM_RIGHTS (none for Stop)
+//   reply:   u8 status | u64 LE output bytes | u32 LE message size | message
+class CompressionDaemon {
+    public:
+
+    enum Op : uint8_t {
+        Compress = 1,
+        Decompress = 2,
+        Stop = 3,         // the daemon replies, then stops accepting
+    };
+
+    enum Status : uint8_t {
+        Ok = 0,
+        Failed = 1,       // message says why
+    };
+
+    // binds socket_path, replacing a stale socket file, and starts the event loop and one
+    // handler thread per request served at a time. Writing to a closed pipe raises SIGPIPE,
+    // processes that take pipes from clients should ignore it.
+    CompressionDaemon(ThreadedCompressor& compressor, std::string socket_path, size_t connections = 4);
+
+    // stops, waits for requests in progress and removes the socket file
+    ~CompressionDaemon();
+
+    CompressionDaemon(const CompressionDaemon&) = delete;
+    CompressionDaemon& operator=(const CompressionDaemon&) = delete;
+
+    // blocks until stop is called or a client sends Stop
+    void wait();
+
+    // stops accepting and drops idle connections. Requests in progress still get their reply,
+    // those waiting on client I/O fail with it.
+    void stop();
+
+    size_t requestsServed() const;
+
+    // largest input a request may pass and largest output a decompress request may ask for.
+    // A decompress request is checked against its archive index before anything is
+    // allocated, so one request cannot make the daemon allocate what the index claims.
+    static constexpr uint64_t kDefaultMaxRequestSize = uint64_t{1} << 30;
+    void setMaxRequestSize(uint64_t bytes);
+
+    // time a request may take from its arrival to its reply
+    static constexpr std::chrono::milliseconds kDefaultRequestTimeout{60'000};
+    void setRequestTimeout(std::chrono::milliseconds timeout);
+
+    private:
+
+    void eventLoop();
+    void handlerLoop();
+
+    // serves one request of a readable connection, false when the connection is done
+    bool serve(int connection);
+
+    // runs one request, returns the output size
+    uint64_t run(Op op, int input, int output, std::chrono::steady_clock::time_point deadline);
+
+    ThreadedCompressor& compressor;
+    std::string socket_path;
+    int listen_fd = -1;
+    int stop_fd = -1;   // eventfd, readable once stop was called
+    int wake_fd = -1;   // eventfd, wakes the event loop for returned connections
+    std::thread event_thread;
+    std::vector<std::thread> handlers;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping = false;
+    std::set<int> connections;   // open client connections, closed by the destructor
+    std::deque<int> ready;       // connections with a request waiting for a handler
+    std::vector<int> returned;   // served connections going back to the event loop
+    std::atomic<size_t> requests_served{0};
+    std::atomic<uint64_t> max_request_size{kDefaultMaxRequestSize};
+    std::atomic<std::chrono::milliseconds> request_timeout{kDefaultRequestTimeout};
+};
+
+// Thin client of a CompressionDaemon, one connection that serves any number of requests.
+// Errors reported by the daemon are thrown as std::runtime_error, socket errors as
+// std::system_error.
+class DaemonClient {
+    public:
+
+    explicit DaemonClient(const std::string& socket_path);
+    ~DaemonClient();
+
+    DaemonClient(const DaemonClient&) = delete;
+    DaemonClient& operator=(const DaemonClient&) = delete;
+
+    // buffers travel in memfds: the input in a sealed one per request that the daemon maps,
+    // the output in one the client keeps and the daemon writes into
+    std::vector<uint8_t> compress(std::span<const uint8_t> input);
+    std::vector<uint8_t> decompress(std::span<const uint8_t> archive);
+
+    // file to file through the client's descriptors, so the daemon needs no access to the
+    // paths; returns the bytes written
+    uint64_t compressFile(const std::string& input_path, const std::string& output_path);
+    uint64_t decompressFile(const std::string& input_path, const std::string& output_path);
+
+    // asks the daemon to shut down
+    void stopDaemon();
+
+    private:
+
+    uint64_t request(CompressionDaemon::Op op, int input, int output);
+    std::vector<uint8_t> roundTrip(CompressionDaemon::Op op, std::span<const uint8_t> data);
+    uint64_t fileToFile(CompressionDaemon::Op op, const std::string& input_path, const std::string& output_path);
+
+    int fd = -1;
+    int output_buffer = -1;
+};
@@ -2,15 +2,50 @@
 
 #include <vector>
 #include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <limits>
 
 class Compressor {
     public:
 
     struct EncodedData {
         std::vector<uint8_t> bits;
-        uint8_t padding;   // how many extra bits were added to final byte
+        uint8_t padding = 0;   // how many extra bits were added to final byte
     };
 
+    virtual ~Compressor() = default;
+
     virtual EncodedData compress(const std::vector<uint8_t>& chunk) = 0;
-    virtual std::vector<uint8_t> decompress(EncodedData& chunk) = 0;
-};
\ No newline at end of file
+    virtual std::vector<uint8_t> decompress(const EncodedData& chunk) = 0;
+
+    // worst case compressed size of an n byte chunk, header included
+    virtual size_t compressBound(size_t n) const = 0;
+
+    // compresses into a caller-supplied buffer of at least compressBound(chunk.size()) bytes,
+    // returns the number of bytes written
+    virtual size_t compress(std::span<const uint8_t> chunk, std::span<uint8_t> out, uint8_t& padding) = 0;
+
+    // decompresses a chunk straight into a buffer sized for its original bytes,
+    // returns the number of bytes written
+    virtual size_t decompress(std::span<const uint8_t> bits, uint8_t padding, std::span<uint8_t> out) = 0;
+
+    // most bytes a compressed chunk can decode to, so a reader can reject an archive index
+    // that claims more before allocating the output; no bound by default
+    virtual size_t decompressBound(std::span<const uint8_t> bits) const {
+        (void)bits;
+        return std::numeric_limits<size_t>::max();
+    }
+
+    // Coders may carry state from one chunk to the next, like a code table a later chunk
+    // refers back to. Chunks of one stream are then compressed and decompressed in order on
+    // one instance, and resetStream starts a new stream.
+    virtual void resetStream() {}
+
+    // whether a compressed chunk decodes without the chunks before it in its stream
+    virtual bool standsAlone(std::span<const uint8_t> bits) const { (void)bits; return true; }
+
+    // fresh instance with the same configuration, one per worker thread
+    virtual std::unique_ptr<Compressor> clone() const = 0;
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <span>
+#include <cstdint>
+#include <cstddef>
+
+// Order-1 huffman coding: the previous byte selects one of a few canonical code tables.
+// Previous bytes whose successors look alike share a table, so a chunk pays for a handful
+// of tables instead of 256, and the tables are stored as code lengths only.
+//
+//   u8 tables | 4 bit table per previous byte (only with 2+ tables) |
+//   per table: 256 bit symbol mask, 4 bit code length per present symbol | payload
+class ContextCoder {
+    public:
+
+    static constexpr size_t kMaxTables = 16;
+
+    // short enough for one table lookup per decoded byte, long enough for 256 symbols
+    static constexpr unsigned int kMaxCodeLength = 11;
+
+    // clusters the chunk's contexts into at most max_tables tables and builds their codes,
+    // returns the exact encoded size in bits, header included
+    uint64_t plan(std::span<const uint8_t> chunk, size_t max_tables);
+
+    // writes the planned header and payload; returns the bytes written, or 0 when they do
+    // not fit in out
+    size_t encode(std::span<const uint8_t> chunk, std::span<uint8_t> out, uint8_t& padding) const;
+
+    // decodes a chunk written by encode, throws when it does not fit in out
+    size_t decode(std::span<const uint8_t> data, uint8_t padding, std::span<uint8_t> out);
+    std::vector<uint8_t> decode(std::span<const uint8_t> data, uint8_t padding);
+
+    private:
+
+    struct Code {
+        uint16_t bits = 0;
+        uint8_t length = 0;
+    };
+
+    // code lengths for a histogram, limited to kMaxCodeLength by flattening the counts
+    static void buildLengths(const std::array<uint32_t, 256>& freq, std::array<uint8_t, 256>& lengths);
+
+    // groups the active contexts into k tables, returns the encoded size in bits
+    uint64_t cluster(size_t k);
+
+    // canonical codes of every table from its lengths
+    void assignCodes();
+
+    // parses the header into lengths and decode tables, returns where the payload starts
+    size_t readHeader(std::span<const uint8_t> data);
+
+    template <typename Emit>
+    void decodePayload(std::span<const uint8_t> payload, uint8_t padding, Emit&& emit) const;
+
+    size_t header_bits = 0;
+    size_t table_count = 0;
+    std::array<uint8_t, 256> context_map{};
+    std::array<std::array<uint8_t, 256>, kMaxTables> lengths{};
+    std::array<std::array<Code, 256>, kMaxTables> codes{};
+    std::vector<uint16_t> decode_table;   // symbol << 4 | length, kMaxCodeLength bit index
+
+    // planning scratch, reused across chunks
+    std::vector<std::array<uint32_t, 256>> counts;
+    std::vector<uint8_t> active;          // contexts seen in the chunk, busiest first
+    std::vector<std::pair<uint8_t, uint32_t>> successors;
+    std::vector<size_t> successor_start;
+    size_t trial_tables = 0;
+    std::array<uint8_t, 256> trial_map{};
+    std::array<std::array<uint8_t, 256>, kMaxTables> trial_lengths{};
+    std::vector<std::array<uint32_t, 256>> cluster_counts;
+};
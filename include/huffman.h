@@ -1,8 +1,15 @@
+#pragma once
+
 #include "compressor.h"
+#include "context_coder.h"
+#include "huffman_kernels.h"
 #include <unordered_map>
+#include <map>
+#include <array>
 #include <string>
 #include <memory>
 #include <queue>
+#include <span>
 #include <iostream>
 
 struct HuffmanNode {
@@ -23,17 +30,55 @@ struct HuffmanNode {
     };
 };
 
+class HuffmanDictionary;
+
 class Huffman : public Compressor {
     public:
 
+    // first byte of every compressed chunk, says where the code table comes from
+    enum TableKind : uint8_t {
+        CustomTable = 0,    // serialized tree follows
+        StaticTable = 1,    // one byte dictionary id follows
+        ContextTables = 2,  // order-1 tables picked by the previous byte, see ContextCoder
+        RepeatTable = 3,    // payload only, coded with the last custom table of the stream
+    };
+
+    // a full tree over 256 symbols has 511 nodes and serializes to 767 bytes
+    static constexpr size_t kMaxNodes = 511;
+    static constexpr size_t kMaxTreeBytes = 767;
+
     Huffman() = default;
     ~Huffman() = default;
+    // tree nodes point into node storage, so instances are not copyable
+    Huffman(const Huffman&) = delete;
+    Huffman& operator=(const Huffman&) = delete;
+
     // override compression interface functions
     virtual EncodedData compress(const std::vector<uint8_t>& chunk) override;
-    virtual std::vector<uint8_t> decompress(EncodedData& chunk) override;
+    virtual std::vector<uint8_t> decompress(const EncodedData& chunk) override;
+    virtual size_t compressBound(size_t n) const override;
+    virtual size_t compress(std::span<const uint8_t> chunk, std::span<uint8_t> out, uint8_t& padding) override;
+    virtual size_t decompress(std::span<const uint8_t> bits, uint8_t padding, std::span<uint8_t> out) override;
+    virtual size_t decompressBound(std::span<const uint8_t> bits) const override;
+    virtual void resetStream() override;
+    virtual bool standsAlone(std::span<const uint8_t> bits) const override;
+    virtual std::unique_ptr<Compressor> clone() const override;
+
+    // registers a pre-trained table that compress may pick per chunk and decompress resolves by id
+    void addDictionary(std::shared_ptr<const HuffmanDictionary> dictionary);
+
+    // lets compress code a chunk with up to max_tables tables selected by the previous byte
+    // when that comes out smaller than one table; 1 (the default) turns it off. Decoding
+    // handles every table kind regardless.
+    void setContextTables(size_t max_tables);
+
+    // lets compress code a chunk with the stream's previous custom table instead of sending a
+    // new one, when that costs at most max_penalty (0.02 = 2%) more than the smallest table
+    // the chunk could get; off by default. Decoding handles repeat chunks regardless.
+    void setTableReuse(double max_penalty);
 
     // build table mapping frequencies of each byte
-    void buildFrequencyTable(const std::vector<uint8_t>& chunk);
+    void buildFrequencyTable(std::span<const uint8_t> chunk);
 
     // builds huffman tree from frequency table according to huffman coding algorithm
     void buildHuffmanTree();
@@ -42,24 +87,72 @@ class Huffman : public Compressor {
     void generateCodes(HuffmanNode* node, std::string& current);
 
     // produces the compressed huffman coding of the uncompressed chunk
-    EncodedData encodeData(const std::vector<uint8_t>& chunk);
+    EncodedData encodeData(const std::vector<uint8_t>& chunk) const;
+
+    // appends the huffman coding of the chunk to out.bits and sets out.padding
+    void encodeData(const std::vector<uint8_t>& chunk, EncodedData& out) const;
+
+    // writes the huffman coding of the chunk straight into out, returns the bytes written;
+    // out must hold encodedBound(chunk.size()) bytes
+    size_t encodeData(std::span<const uint8_t> chunk, std::span<uint8_t> out, uint8_t& padding) const;
+
+    // most bytes encodeData can produce for n input bytes with the current codes
+    size_t encodedBound(size_t n) const;
 
     // transforms the compressed data back to the original based on the generated huffman codes
-    std::vector<uint8_t> decodeData(EncodedData& data);
+    std::vector<uint8_t> decodeData(const EncodedData& data) const;
+    std::vector<uint8_t> decodeData(std::span<const uint8_t> bits, uint8_t padding) const;
+
+    // decodes into a buffer sized for the original chunk, returns the bytes written
+    size_t decodeData(std::span<const uint8_t> bits, uint8_t padding, std::span<uint8_t> out) const;
 
+    // pre-order tree encoding: 0 marks an internal node, 1 marks a leaf followed by its byte
     void serializeTree(const HuffmanNode* node, std::vector<uint8_t>& out);
-    std::unique_ptr<HuffmanNode> deserializeTree(const std::vector<uint8_t>& data, size_t& index);
+    HuffmanNode* deserializeTree(std::span<const uint8_t> data, size_t& index);
+
+    // replaces the current tree and codes with a serialized tree
+    void loadTree(const std::vector<uint8_t>& serialized);
 
     // getters
     HuffmanNode* getRoot();
     std::unordered_map<uint8_t, int> getFrequencyTable();
     std::unordered_map<uint8_t, std::string> getHuffmanCodes();
+    unsigned int getMaxCodeLength() const;
+
+    // decode table of the current tree, for driving HuffmanKernels directly; it points into
+    // this coder's nodes, so it is valid until the tree changes
+    HuffmanDecodeTable getDecodeTable() const;
 
     private:
 
-    HuffmanNode* root;
-    std::vector<std::unique_ptr<HuffmanNode>> owned_nodes;
-    std::unordered_map<uint8_t, int> frequency_table;
-    std::unordered_map<uint8_t, std::string> huffman_codes;
+    // lower bound on the bits a chunk-specific table would need, header included
+    uint64_t customTableLowerBound() const;
+
+    // writes the pre-order tree encoding into a preallocated buffer
+    void writeTree(const HuffmanNode* node, std::span<uint8_t> out, size_t& pos) const;
 
-};
\ No newline at end of file
+    // drops the current tree and codes, node storage keeps its capacity
+    void resetTree();
+
+    // lookup table of the current tree, built here into scratch unless the tree came with one
+    const HuffmanDecodeTable& decodeTable(HuffmanDecodeTable& scratch) const;
+
+    // reads the table header, returns the coder for the payload and where the payload starts
+    const Huffman& prepareDecoder(std::span<const uint8_t> bits, size_t& index);
+
+    HuffmanNode* root = nullptr;
+    std::vector<HuffmanNode> nodes;
+    std::vector<HuffmanNode*> heap;
+    std::array<uint32_t, 256> frequency_table{};
+    std::array<HuffmanCode, 256> codes{};
+    uint8_t max_code_length = 0;
+    std::string code_path;
+    std::map<uint8_t, std::shared_ptr<const HuffmanDictionary>> dictionaries;
+    size_t context_tables = 1;
+    ContextCoder context_coder;
+    double reuse_penalty = -1;   // negative when reuse is off
+    bool codes_sent = false;     // codes belong to the last custom table written to the stream
+    HuffmanDecodeTable decode_table;
+    bool decode_table_ready = false;   // built for trees that get decoded, not for every encoder tree
+
+};
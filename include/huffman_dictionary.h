@@ -0,0 +1,47 @@
+#pragma once
+
+#include "huffman.h"
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// pre-trained code table that small chunks reference by id instead of storing their own tree
+class HuffmanDictionary {
+    public:
+
+    static constexpr size_t kMaxNameLength = 255;
+    static constexpr size_t kMaxCodeLength = 64;   // codes are kept in a HuffmanCode's 64 bits
+
+    // throws std::invalid_argument for a name over kMaxNameLength bytes or a tree deeper
+    // than kMaxCodeLength
+    HuffmanDictionary(uint8_t id, std::string name, std::vector<uint8_t> tree);
+
+    // trains a table from a sample corpus, every byte value gets a code so any chunk is encodable
+    static std::shared_ptr<HuffmanDictionary> train(uint8_t id, const std::string& name,
+                                                    const std::vector<std::vector<uint8_t>>& samples);
+
+    // dictionary file layout: "MTCD" magic, id, name length, name, serialized tree
+    std::vector<uint8_t> serialize() const;
+    static std::shared_ptr<HuffmanDictionary> deserialize(const std::vector<uint8_t>& data);
+
+    void save(const std::string& fileName) const;
+    static std::shared_ptr<HuffmanDictionary> load(const std::string& fileName);
+
+    // payload bits this table spends on a chunk with the given byte frequencies
+    uint64_t encodedBits(const std::array<uint32_t, 256>& frequencies) const;
+
+    // getters
+    uint8_t getId() const;
+    const std::string& getName() const;
+    const Huffman& getCoder() const;
+
+    private:
+
+    uint8_t id;
+    std::string name;
+    std::vector<uint8_t> tree;
+    Huffman coder;
+    std::array<uint8_t, 256> code_lengths{};
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <span>
+#include <cstdint>
+#include <cstddef>
+
+struct HuffmanNode;
+
+// code bits are right aligned, the first bit sent is the highest of length
+struct HuffmanCode {
+    uint64_t bits = 0;
+    uint8_t length = 0;
+};
+
+// Lookup table over the next kTableBits bits of a huffman stream. Short codes resolve in one
+// lookup, longer ones continue walking the tree from the node the table points at.
+struct HuffmanDecodeTable {
+    static constexpr unsigned kTableBits = 11;
+    static constexpr uint16_t kLongCode = 0x8000;   // low bits are an index into nodes
+
+    std::array<uint16_t, size_t(1) << kTableBits> entries{};   // length << 8 | byte, or kLongCode | node
+    const HuffmanNode* nodes = nullptr;
+    unsigned int min_length = 0;
+    unsigned int max_length = 0;   // 0 for an empty tree
+};
+
+// Bit loops of Huffman::encodeData and decodeData. Every loop is instantiated for a set of
+// longest code lengths, so a whole group of codes is moved per 64 bit refill or flush without
+// per bit checks, and for each instruction set the machine may have. The best instruction set
+// is detected once, the length variant is picked per chunk.
+class HuffmanKernels {
+    public:
+
+    enum class Isa : uint8_t {
+        Scalar,
+        Bmi2,   // flag-free variable shifts (shlx/shrx), x86-64 only
+    };
+
+    static bool supported(Isa isa);
+
+    // best supported instruction set, detected on first use
+    static Isa best();
+
+    // builds the decode table of a tree whose nodes live in one array starting at nodes
+    static void buildDecodeTable(const HuffmanNode* root, const HuffmanNode* nodes, HuffmanDecodeTable& table);
+
+    // writes the codes of chunk into out, which holds at least (chunk.size() * max_length + 7) / 8
+    // bytes; returns the bytes written. Throws when a byte has no code.
+    static size_t encode(std::span<const uint8_t> chunk, const std::array<HuffmanCode, 256>& codes,
+                         unsigned int max_length, std::span<uint8_t> out, uint8_t& padding, Isa isa = best());
+
+    // decodes a payload into out, returns the bytes written; throws when out is too small or
+    // the payload ends inside a code
+    static size_t decode(std::span<const uint8_t> bits, uint8_t padding, const HuffmanDecodeTable& table,
+                         std::span<uint8_t> out, Isa isa = best());
+};
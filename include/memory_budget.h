@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <condition_variable>
+
+// Caps the bytes of chunks in flight across every job sharing it. Producers acquire a
+// chunk's bytes before reading or submitting it and give them back once its result has
+// been delivered, so concurrent jobs together stay near the limit instead of each holding
+// its whole input and output at once.
+class MemoryBudget {
+    public:
+
+    static constexpr size_t kUnlimited = std::numeric_limits<size_t>::max();
+
+    struct Usage {
+        size_t limit = kUnlimited;
+        size_t in_flight = 0;
+        size_t peak = 0;       // highest in_flight since the limit was set
+        size_t waits = 0;      // acquires that had to block
+    };
+
+    explicit MemoryBudget(size_t limit = kUnlimited);
+
+    // a lower limit lets current holders finish, a higher one wakes blocked producers;
+    // restarts the peak
+    void setLimit(size_t bytes);
+
+    // takes bytes when they fit; a request bigger than the whole limit fits once nothing
+    // else is in flight, so an oversized chunk still makes progress
+    bool tryAcquire(size_t bytes);
+
+    // blocks until tryAcquire would succeed. Callers that hold bytes themselves must only
+    // block once they have nothing left to deliver, or they wait on their own bytes.
+    void acquire(size_t bytes);
+
+    // takes bytes without waiting, for callers that must not block, like worker threads
+    void forceAcquire(size_t bytes);
+
+    void release(size_t bytes);
+
+    Usage usage() const;
+
+    private:
+
+    bool fits(size_t bytes) const;
+    void take(size_t bytes);
+
+    mutable std::mutex mutex;
+    std::condition_variable cv;
+    Usage state;
+};
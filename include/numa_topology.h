@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+// NUMA nodes of the machine and the cpus this process may run on in each of them
+class NumaTopology {
+    public:
+
+    struct Node {
+        int id;
+        std::vector<int> cpus;
+    };
+
+    struct Placement {
+        int node;
+        int cpu;
+    };
+
+    explicit NumaTopology(std::vector<Node> nodes);
+
+    // libnuma when it is available, then sysfs, then one node holding every cpu
+    static NumaTopology detect();
+
+    // spreads workers over nodes round robin and gives each its own cpu within the node
+    Placement placeWorker(size_t worker) const;
+
+    // pins the calling thread to one cpu, false when the OS refuses
+    static bool pinCurrentThread(int cpu);
+
+    // binds the whole pages inside [data, data + size) to a node, migrating any already
+    // touched; the partial pages at either end and, without libnuma, everything is left to
+    // first-touch placement by the caller
+    static void bindMemory(void* data, size_t size, int node);
+
+    static bool hasLibnuma();
+
+    // getters
+    const std::vector<Node>& getNodes() const;
+
+    private:
+
+    std::vector<Node> nodes;
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+
+// Token bucket pacing the bytes callers take on per second. The bucket holds at most a
+// tenth of a second of bytes and may be overdrawn by one request, so a chunk larger than
+// the bucket still goes through and the next caller waits until the debt is paid off.
+class RateLimiter {
+    public:
+
+    static constexpr uint64_t kUnlimited = 0;
+
+    explicit RateLimiter(uint64_t bytes_per_second = kUnlimited);
+
+    // applies to callers already waiting, kUnlimited lets them all go
+    void setRate(uint64_t bytes_per_second);
+    uint64_t getRate() const;
+
+    // blocks until the bucket is out of debt, then takes bytes
+    void acquire(size_t bytes);
+
+    // time callers spent blocked in acquire
+    std::chrono::nanoseconds getWaited() const;
+
+    private:
+
+    using Clock = std::chrono::steady_clock;
+
+    void refill(Clock::time_point now);
+
+    mutable std::mutex mutex;
+    std::condition_variable cv;
+    uint64_t rate;
+    double tokens = 0;   // negative while in debt
+    Clock::time_point last;
+    std::chrono::nanoseconds waited{0};
+};
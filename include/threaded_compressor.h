@@ -7,55 +7,291 @@
 #include <mutex>
 #include <condition_variable>
 #include <optional>
+#include <atomic>
+#include <limits>
+#include <functional>
+#include <istream>
+#include <exception>
+#include <chrono>
+#include <latch>
+#include <ostream>
+#include <iostream>
 
 #include "compressor.h"
 #include "huffman.h"
 #include "chunker.h"
 #include "file_io.h"
+#include "buffer_pool.h"
+#include "auto_tuner.h"
+#include "numa_topology.h"
+#include "archive.h"
+#include "async_job.h"
+#include "memory_budget.h"
+#include "rate_limiter.h"
+#include <sys/types.h>
 
 class ThreadedCompressor {
 public:
+    // pass as chunkSize or thread_count to let the compressor pick from the input and machine
+    static constexpr size_t kAuto = 0;
+
+    // where workers run and where their buffers live
+    enum class Placement {
+        Floating,     // the OS schedules workers anywhere, one shared work queue
+        NumaPinned,   // workers pinned to cores across NUMA nodes, per-node queues and node-local buffers
+    };
+
     explicit ThreadedCompressor(std::unique_ptr<Compressor> comp, size_t chunkSize,
-                                size_t thread_count = std::thread::hardware_concurrency());
+                                size_t thread_count = std::thread::hardware_concurrency(),
+                                Placement placement = Placement::Floating);
+    ~ThreadedCompressor();
+
+    ThreadedCompressor(const ThreadedCompressor&) = delete;
+    ThreadedCompressor& operator=(const ThreadedCompressor&) = delete;
 
     // High-level API
     std::vector<Compressor::EncodedData> compressFile(const std::string& input_path);
 
     std::vector<uint8_t> decompressFile(const std::vector<Compressor::EncodedData>& compressed);
 
+    // in-memory API; inputs of at most kInlineThreshold bytes skip the pool and run on the calling
+    // thread, unless a QoS limit is set
+    static constexpr size_t kInlineThreshold = 64 * 1024;
+
+    // compresses a buffer into a self-contained archive (see Archive) and back
+    std::vector<uint8_t> compress(std::span<const uint8_t> input);
+    std::vector<uint8_t> decompress(std::span<const uint8_t> archive);
+
+    // adds data to the end of an archive as new chunks; existing chunks are neither read nor
+    // recompressed, only the trailing index is rewritten, so the cost follows the new bytes
+    void append(std::vector<uint8_t>& archive, std::span<const uint8_t> data);
+
+    // same on an archive file, which is created when it does not exist yet
+    void appendFile(const std::string& archive_path, std::span<const uint8_t> data);
+
+    // many independent buffers spread over the workers as one job, one archive per buffer
+    std::vector<std::vector<uint8_t>> compressBatch(const std::vector<std::span<const uint8_t>>& inputs);
+    std::vector<std::vector<uint8_t>> decompressBatch(const std::vector<std::span<const uint8_t>>& archives);
+
+    // non-blocking compress/decompress, the input moves into the job. Every job keeps at most
+    // one chunk per worker queued, so concurrent jobs interleave on the pool instead of the
+    // first big one holding every core until it is done.
+    AsyncJob compressAsync(std::vector<uint8_t> input, AsyncJob::Options options = {});
+    AsyncJob decompressAsync(std::vector<uint8_t> archive, AsyncJob::Options options = {});
+
+    // compresses input chunk by chunk and hands each chunk to sink in order; chunk buffers
+    // go back to the worker pools once sink returns, so a long stream allocates nothing per chunk
+    void compressStream(std::istream& input, const std::function<void(const Compressor::EncodedData&)>& sink);
+
+    // caps the bytes of chunks in flight over the pooled calls and jobs on this compressor:
+    // compress, decompress, compressStream and async jobs. A chunk counts its input plus its
+    // worst case output, a decoded chunk its compressed and decoded bytes; the whole output
+    // a call returns is not counted, nor are inline calls and the batch APIs. Callers feeding
+    // chunks block at the cap, async jobs keep at least one chunk going.
+    // MemoryBudget::kUnlimited (the default) turns it off.
+    void setMemoryBudget(size_t bytes);
+
+    // caps the output of decompress, decompressBatch (per archive) and decompressAsync; an
+    // archive whose index claims more fails before anything is allocated. Unlimited by default.
+    void setMaxOutputSize(size_t bytes);
+
+    // scheduling priority of the worker threads
+    enum class Priority {
+        Normal,
+        Low,    // nice 19
+        Idle,   // SCHED_IDLE, runs only on cores nothing else wants
+    };
+
+    // Throttles the pool for hosts it shares with latency-sensitive work. While any limit is
+    // set, calls that would run inline on the caller's thread go through the pool as well.
+    struct Qos {
+        size_t max_workers = kAuto;                       // workers taking tasks, kAuto for all of them
+        Priority priority = Priority::Normal;
+        uint64_t bytes_per_second = RateLimiter::kUnlimited;   // input bytes the workers take on
+    };
+
+    // applies at once to calls and jobs in progress: workers over max_workers stop after
+    // their current task and the rest pick up the new priority and rate. Going back up from
+    // Low or Idle needs CAP_SYS_NICE or RLIMIT_NICE; a refusal throws std::system_error
+    // after the worker count and rate took effect, with the priority left as it was.
+    void setQos(const Qos& qos);
+    Qos getQos() const;
+
+    struct Metrics {
+        size_t chunks_compressed = 0;
+        size_t chunks_decompressed = 0;
+        size_t buffer_allocations = 0;   // heap allocations made by the buffer pools
+        size_t inline_calls = 0;         // in-memory calls served on the calling thread
+        size_t chunk_size = 0;           // chunk size the last compression ended with
+        size_t thread_count = 0;         // workers the last compression kept busy
+        MemoryBudget::Usage memory;      // chunk bytes in flight against the budget
+        size_t active_workers = 0;       // workers the QoS setting lets take tasks
+        std::chrono::nanoseconds throttled{0};   // time workers waited on the rate limit
+    };
+
+    Metrics getMetrics() const;
+
+    // where auto mode reports the parameters it picked, nullptr silences it
+    void setLog(std::ostream* log);
+
 private:
-    // Core thread functionality
-    void workerThread();
+    // each worker owns its compressor and a pool of recycled output buffers
+    struct Worker {
+        explicit Worker(int node = -1, int cpu = -1)
+        : node(node), cpu(cpu), pool(node) {
 
-    // Task structure sent to workers
-    struct Task {
-        size_t chunk_index;
-        std::vector<uint8_t> data;
-        bool is_decompression;
+        };
+
+        int node;      // NUMA node the worker is pinned to, -1 when floating
+        int cpu;
+        size_t queue;  // queue the worker serves first
+        size_t index = 0;
+        pid_t tid = 0;   // kernel thread id, for changing the worker's priority
+        std::thread thread;
+        std::unique_ptr<Compressor> compressor;
+        BufferPool pool;
     };
 
     // Result from each worker
     struct Result {
-        size_t chunk_index;
+        size_t chunk_index = 0;
         Compressor::EncodedData encoded;
         std::vector<uint8_t> decoded;
+        BufferPool* pool = nullptr;   // owner of encoded.bits when the buffer is recycled
+        size_t input_size = 0;
+        std::chrono::nanoseconds elapsed{0};
+        bool done = false;
+    };
+
+    // chunks submitted together, the submitter waits until pending drops to zero
+    struct Batch {
+        std::mutex mutex;
+        std::condition_variable cv;
+        size_t pending = 0;
+        std::exception_ptr error;
     };
 
+    // Task structure sent to workers
+    struct Task {
+        size_t chunk_index = 0;
+        std::span<const uint8_t> data{};                    // input when compressing, archive for entries
+        size_t chunk_count = 1;   // consecutive chunks run in order, result points at the first of their results
+        const Compressor::EncodedData* encoded = nullptr;   // input when decompressing into result
+        std::span<const Archive::Entry> entries{};          // or archive chunks decoded into output
+        std::span<uint8_t> output{};
+        bool is_decompression = false;
+        bool recycle = false;   // leave encoded.bits in the worker's pooled buffer
+        // batch jobs: a group of independent buffers, each turned into or out of an archive
+        std::span<const std::span<const uint8_t>> batch_inputs{};
+        std::span<std::vector<uint8_t>> batch_outputs{};
+        Result* result = nullptr;
+        Batch* batch = nullptr;
+        std::shared_ptr<AsyncJob::State> job{};   // set instead of result and batch for async jobs
+        size_t charged = 0;                       // budget bytes an async task gives back when it ends
+    };
+
+    // Core thread functionality
+    void workerThread(Worker& worker, std::latch& started);
+    void runTask(Worker& worker, Task& task);
+    void compressChunk(Worker& worker, std::span<const uint8_t> chunk, bool recycle, Result& result);
+
+    // first chunk of every run a chunk sequence splits into, a run starts at each chunk that
+    // decodes without the ones before it
+    template <typename ChunkBits>
+    std::vector<size_t> runStarts(size_t count, ChunkBits&& bits) const;
+
+    void submit(const Task& task);
+
+    // input bytes a task reads, charged against the rate limit
+    size_t taskBytes(const Task& task) const;
+
+    // async jobs: runs one chunk, then refills the job's share of the queue or completes it
+    void runJobChunk(Worker& worker, Task& task);
+    void scheduleJob(const std::shared_ptr<AsyncJob::State>& job, bool chunk_finished, std::exception_ptr failure);
+
+    // blocks until every task of the batch finished, rethrows the first failure
+    void waitForBatch(Batch& batch);
+
+    // Supplies the next chunk of at most the given size, empty at end of input. Chunks that
+    // are not views into caller memory are read into storage, which comes from input_pool_.
+    using ChunkSource = std::function<std::span<const uint8_t>(size_t max_size, std::vector<uint8_t>& storage)>;
+
+    // compresses chunks in order with a bounded number in flight, feeding timings to the
+    // tuner when one is given; buffers are recycled once deliver returns
+    void runPipeline(const ChunkSource& source, AutoTuner* tuner,
+                     const std::function<void(const Compressor::EncodedData&, size_t original_size)>& deliver);
+
+    size_t queueDepth();
+
+    // budget bytes of compressing a chunk: its input plus its worst case output
+    size_t chunkCost(size_t input_size) const;
+
+    // compresses data with the configured chunking and hands the chunks to emit in order
+    void compressData(std::span<const uint8_t> data,
+                      const std::function<void(Compressor::EncodedData&& encoded, size_t original_size)>& emit);
+
+    // single threaded archive codecs for inline calls and batch tasks
+    std::vector<uint8_t> compressArchive(Compressor& comp, std::span<const uint8_t> input) const;
+    void compressChunks(Compressor& comp, std::span<const uint8_t> input, ArchiveWriter& writer) const;
+
+    // compresses input into the writer's archive, inline when small and on the pool otherwise
+    void writeChunks(std::span<const uint8_t> input, ArchiveWriter& writer);
+
+    // new payloads plus the rewritten index and footer for an append after entries
+    std::vector<uint8_t> appendTail(std::vector<Archive::Entry> entries, uint64_t payload_end,
+                                    std::span<const uint8_t> data);
+    // readIndex plus the checks due before the output is allocated from untrusted sizes:
+    // no chunk claims more than its payload decodes to, the total stays within max_output_
+    std::vector<Archive::Entry> readEntries(std::span<const uint8_t> archive) const;
+    std::vector<uint8_t> decompressArchive(Compressor& comp, std::span<const uint8_t> archive,
+                                           const std::vector<Archive::Entry>& entries) const;
+
+    // spreads a batch over the workers in groups of roughly equal bytes
+    std::vector<std::vector<uint8_t>> runBatch(const std::vector<std::span<const uint8_t>>& inputs, bool decompress);
+
+    // small inputs run on the calling thread, except under a QoS limit
+    bool runsInline(size_t bytes) const;
+
+    // compressors lent to calling threads for inline work
+    std::unique_ptr<Compressor> borrowCompressor();
+    void returnCompressor(std::unique_ptr<Compressor> comp);
+
     // Thread pool management
     size_t thread_count;
-    std::vector<std::thread> workers_;
     size_t chunk_size;
+    bool auto_tune;
+    std::ostream* log_ = &std::clog;
+    std::vector<std::unique_ptr<Worker>> workers_;
 
-    // Work queue
-    std::queue<Task> task_queue_;
-    std::mutex queue_mutex_;
+    // Work queues, one per NUMA node when pinned; idle workers steal from other nodes
+    Placement placement;
+    std::vector<std::queue<Task>> task_queues_;
+    size_t next_queue_ = 0;
+    mutable std::mutex queue_mutex_;
     std::condition_variable queue_cv_;
     bool shutdown_flag_ = false;
+    size_t active_workers_ = 0;   // workers with an index below it take tasks
+
+    Qos qos_;
+    mutable std::mutex qos_mutex_;
+    std::atomic<bool> throttled_{false};   // some QoS limit is set
+    RateLimiter throttle_;
+
+    // buffers for chunks read by compressStream
+    BufferPool input_pool_;
+
+    MemoryBudget budget_;
+    std::atomic<size_t> max_output_{std::numeric_limits<size_t>::max()};
+
+    std::atomic<size_t> chunks_compressed_{0};
+    std::atomic<size_t> chunks_decompressed_{0};
+    std::atomic<size_t> inline_calls_{0};
+    std::atomic<size_t> last_chunk_size_{0};
+    std::atomic<size_t> last_thread_count_{0};
 
-    // Completed results
-    std::vector<std::optional<Result>> results_;
-    std::mutex results_mutex_;
+    std::vector<std::unique_ptr<Compressor>> inline_compressors_;
+    std::mutex inline_mutex_;
 
-    // Compressor instance (Huffman)
+    // Compressor instance (Huffman), cloned for every worker
     std::unique_ptr<Compressor> compressor;
 };
@@ -0,0 +1,137 @@
+#include "archive.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+    constexpr uint8_t kMagic[4] = {'M', 'T', 'C', 'A'};
+
+    void putVarint(uint64_t value, std::vector<uint8_t>& out) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<uint8_t>(value) | 0x80);
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    uint64_t getVarint(std::span<const uint8_t> data, size_t& pos) {
+        uint64_t value = 0;
+        for (unsigned int shift=0; shift<64; shift+=7) {
+            if (pos >= data.size()) {
+                throw std::runtime_error("Corrupt archive: truncated index");
+            }
+            uint8_t byte = data[pos++];
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+        throw std::runtime_error("Corrupt archive: varint too long");
+    }
+}
+
+uint64_t Archive::readFooter(std::span<const uint8_t> footer) {
+    if (footer.size() < kFooterSize) {
+        throw std::runtime_error("Corrupt archive: missing footer");
+    }
+    footer = footer.last(kFooterSize);
+    if (!std::equal(std::begin(kMagic), std::end(kMagic), footer.begin() + 8)) {
+        throw std::runtime_error("Corrupt archive: bad magic");
+    }
+    uint64_t index_offset = 0;
+    for (int i=7; i>=0; --i) {
+        index_offset = (index_offset << 8) | footer[i];
+    }
+    return index_offset;
+}
+
+std::vector<Archive::Entry> Archive::readIndex(std::span<const uint8_t> archive) {
+    uint64_t index_offset = readFooter(archive);
+    if (index_offset > archive.size() - kFooterSize) {
+        throw std::runtime_error("Corrupt archive: index offset out of range");
+    }
+    return parseIndex(archive.subspan(index_offset, archive.size() - kFooterSize - index_offset), index_offset);
+}
+
+std::vector<Archive::Entry> Archive::parseIndex(std::span<const uint8_t> index, uint64_t index_offset) {
+    size_t pos = 0;
+    uint64_t count = getVarint(index, pos);
+    if (count > index.size()) {
+        throw std::runtime_error("Corrupt archive: bad chunk count");
+    }
+
+    std::vector<Entry> entries;
+    entries.reserve(count);
+    uint64_t offset = 0;
+    uint64_t total = 0;
+    for (uint64_t i=0; i<count; ++i) {
+        Entry entry;
+        entry.offset = offset;
+        entry.compressed_size = getVarint(index, pos);
+        entry.original_size = getVarint(index, pos);
+        if (pos >= index.size()) {
+            throw std::runtime_error("Corrupt archive: truncated index");
+        }
+        entry.padding = index[pos++];
+        // sizes are untrusted, compare before adding so a sum cannot wrap
+        if (entry.compressed_size > index_offset - offset || entry.padding > 7) {
+            throw std::runtime_error("Corrupt archive: chunk out of range");
+        }
+        if (entry.original_size > std::numeric_limits<size_t>::max() - total) {
+            throw std::runtime_error("Corrupt archive: original sizes overflow");
+        }
+        offset += entry.compressed_size;
+        total += entry.original_size;
+        entries.push_back(entry);
+    }
+    if (offset!=index_offset || pos!=index.size()) {
+        throw std::runtime_error("Corrupt archive: index does not match payloads");
+    }
+    return entries;
+}
+
+void Archive::writeIndex(const std::vector<Entry>& entries, uint64_t index_offset, std::vector<uint8_t>& out) {
+    putVarint(entries.size(), out);
+    for (const auto& entry : entries) {
+        putVarint(entry.compressed_size, out);
+        putVarint(entry.original_size, out);
+        out.push_back(entry.padding);
+    }
+    for (int i=0; i<8; ++i) {
+        out.push_back(static_cast<uint8_t>(index_offset >> (8 * i)));
+    }
+    out.insert(out.end(), std::begin(kMagic), std::end(kMagic));
+}
+
+uint64_t Archive::originalSize(const std::vector<Entry>& entries) {
+    uint64_t total = 0;
+    for (const auto& entry : entries) {
+        if (entry.original_size > std::numeric_limits<size_t>::max() - total) {
+            throw std::runtime_error("Corrupt archive: original sizes overflow");
+        }
+        total += entry.original_size;
+    }
+    return total;
+}
+
+void ArchiveWriter::add(std::span<const uint8_t> bits, uint8_t padding, size_t original_size) {
+    auto space = reserve(bits.size());
+    std::copy(bits.begin(), bits.end(), space.begin());
+    commit(bits.size(), padding, original_size);
+}
+
+std::span<uint8_t> ArchiveWriter::reserve(size_t size) {
+    reserved_at = out.size();
+    out.resize(reserved_at + size);
+    return std::span<uint8_t>(out).subspan(reserved_at);
+}
+
+void ArchiveWriter::commit(size_t written, uint8_t padding, size_t original_size) {
+    out.resize(reserved_at + written);
+    entries.push_back({base + reserved_at - start, written, original_size, padding});
+}
+
+void ArchiveWriter::finish() {
+    uint64_t index_offset = base + out.size() - start;
+    Archive::writeIndex(entries, index_offset, out);
+}
@@ -0,0 +1,97 @@
+#include "async_job.h"
+
+void AsyncJob::cancel() {
+    state->cancelled = true;
+}
+
+bool AsyncJob::isDone() const {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->done;
+}
+
+AsyncJob::Progress AsyncJob::getProgress() const {
+    Progress progress;
+    progress.chunks_done = state->chunks_done;
+    progress.chunks_total = state->chunks.size();
+    progress.bytes_done = state->bytes_done;
+    progress.bytes_total = state->bytes_total;
+    return progress;
+}
+
+std::vector<uint8_t> AsyncJob::get() {
+    {
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->cv.wait(lock, [this]() { return state->done; });
+    }
+    return takeResult();
+}
+
+bool AsyncJob::await_ready() const {
+    return isDone();
+}
+
+bool AsyncJob::await_suspend(std::coroutine_handle<> continuation) {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (state->done) {
+        return false;   // finished in the meantime, resume right away
+    }
+    state->continuation = continuation;
+    return true;
+}
+
+std::vector<uint8_t> AsyncJob::await_resume() {
+    return takeResult();
+}
+
+std::vector<uint8_t> AsyncJob::takeResult() {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+    return std::move(state->output);
+}
+
+void AsyncJob::State::chunkFinished(size_t input_size) {
+    std::lock_guard<std::mutex> lock(callback_mutex);
+    Progress progress;
+    progress.chunks_done = ++chunks_done;
+    progress.chunks_total = chunks.size();
+    progress.bytes_done = bytes_done += input_size;
+    progress.bytes_total = bytes_total;
+    if (options.on_progress) {
+        options.on_progress(progress);
+    }
+}
+
+void AsyncJob::State::complete(std::vector<uint8_t>&& result, std::exception_ptr failure) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (done || completing) return;
+        completing = true;
+    }
+    // the callback owns the output, waiters of a job with a callback only see the error;
+    // a throwing callback fails the job instead of escaping into the worker thread
+    if (options.on_complete) {
+        try {
+            options.on_complete(std::move(result), failure);
+        }
+        catch (...) {
+            if (!failure) {
+                failure = std::current_exception();
+            }
+        }
+    }
+
+    std::coroutine_handle<> resume;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        output = std::move(result);
+        error = failure;
+        done = true;
+        resume = continuation;
+        cv.notify_all();
+    }
+    if (resume) {
+        resume.resume();
+    }
+}
@@ -0,0 +1,114 @@
+#include "auto_tuner.h"
+#include <algorithm>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+    constexpr size_t kPageSize = 4096;
+
+    long cacheSize(int name) {
+        long size = sysconf(name);
+        return size > 0 ? size : 0;
+    }
+
+    size_t roundToPage(size_t n) {
+        return std::max(kPageSize, (n + kPageSize - 1) / kPageSize * kPageSize);
+    }
+}
+
+AutoTuner::MachineInfo AutoTuner::MachineInfo::detect() {
+    MachineInfo info;
+    info.cores = std::max(1u, std::thread::hardware_concurrency());
+    info.l2_cache_bytes = 1024 * 1024;
+    info.l3_cache_bytes = 8 * 1024 * 1024;
+#ifdef _SC_LEVEL2_CACHE_SIZE
+    if (long size = cacheSize(_SC_LEVEL2_CACHE_SIZE)) {
+        info.l2_cache_bytes = size;
+    }
+#endif
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    if (long size = cacheSize(_SC_LEVEL3_CACHE_SIZE)) {
+        info.l3_cache_bytes = size;
+    }
+#endif
+    return info;
+}
+
+AutoTuner::AutoTuner(size_t input_size, size_t workers, const MachineInfo& machine) {
+    size_t cores = std::max<size_t>(1, std::min(machine.cores, workers));
+
+    // no point waking more workers than there are minimum sized chunks
+    thread_count = cores;
+    if (input_size > 0) {
+        thread_count = std::clamp<size_t>((input_size + kMinChunkSize - 1) / kMinChunkSize, 1, cores);
+    }
+
+    // a chunk and its output buffer should stay in L2, and all active chunks in the shared L3
+    chunk_cap = std::min(machine.l2_cache_bytes / 2, machine.l3_cache_bytes / (2 * thread_count));
+    chunk_cap = std::clamp(roundToPage(chunk_cap), kMinChunkSize, kMaxChunkSize);
+
+    // aim for a few chunks per worker so a slow chunk does not leave the others idle
+    chunk_size = chunk_cap;
+    if (input_size > 0) {
+        chunk_size = std::clamp(roundToPage(input_size / (thread_count * 4)), kMinChunkSize, chunk_cap);
+    }
+
+    // growing past one chunk per worker would leave cores without work
+    growth_cap = kMaxChunkSize;
+    if (input_size > 0) {
+        growth_cap = std::clamp(roundToPage(input_size / thread_count), chunk_size, kMaxChunkSize);
+    }
+}
+
+void AutoTuner::record(size_t chunk_bytes, std::chrono::nanoseconds encode_time, size_t queue_depth) {
+    if (chunk_bytes==0) return;
+
+    double ns_per_byte = static_cast<double>(encode_time.count()) / chunk_bytes;
+    sample_ns_per_byte = samples==0 ? ns_per_byte : sample_ns_per_byte + (ns_per_byte - sample_ns_per_byte) / (samples + 1);
+    sample_min_depth = samples==0 ? queue_depth : std::min(sample_min_depth, queue_depth);
+    samples++;
+
+    // judge a whole round of chunks so one noisy chunk does not flip the size
+    if (samples < thread_count) return;
+
+    double chunk_ns = sample_ns_per_byte * chunk_size;
+    size_t next = chunk_size;
+    if (chunk_ns < std::chrono::nanoseconds(kMinChunkTime).count()) {
+        // setup and header cost dominate, use fewer bigger chunks
+        next = std::min(chunk_size * 2, growth_cap);
+    }
+    else if (chunk_ns > std::chrono::nanoseconds(kMaxChunkTime).count() && sample_min_depth < thread_count) {
+        // workers ran dry while a few long chunks finished, split the work finer
+        next = std::max(chunk_size / 2, kMinChunkSize);
+    }
+    if (next!=chunk_size) {
+        chunk_size = next;
+        adjustments++;
+    }
+    samples = 0;
+}
+
+// getters
+size_t AutoTuner::getChunkSize() const {
+    return chunk_size;
+}
+
+size_t AutoTuner::getThreadCount() const {
+    return thread_count;
+}
+
+size_t AutoTuner::getWindow() const {
+    return 2 * thread_count;
+}
+
+size_t AutoTuner::getAdjustments() const {
+    return adjustments;
+}
+
+std::string AutoTuner::describe() const {
+    std::ostringstream out;
+    out << "auto-tune: chunk_size=" << chunk_size << " threads=" << thread_count
+        << " cache_cap=" << chunk_cap << " adjustments=" << adjustments;
+    return out.str();
+}
@@ -0,0 +1,462 @@
+#include "block_sort.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+    void putU32(uint32_t value, std::span<uint8_t> out, size_t& pos) {
+        for (int i=0; i<4; ++i) {
+            out[pos++] = static_cast<uint8_t>(value >> (8 * i));
+        }
+    }
+
+    uint32_t getU32(std::span<const uint8_t> data, size_t& pos) {
+        if (pos + 4 > data.size()) {
+            throw std::runtime_error("Corrupt block sort header");
+        }
+        uint32_t value = 0;
+        for (int i=0; i<4; ++i) {
+            value |= static_cast<uint32_t>(data[pos++]) << (8 * i);
+        }
+        return value;
+    }
+
+    size_t blockCount(size_t n) {
+        return (n + BlockSort::kBlockSize - 1) / BlockSort::kBlockSize;
+    }
+
+    // bucket heads (or tails when end is set) for every symbol of s
+    void getBuckets(const int32_t* s, int32_t n, std::vector<int32_t>& bucket, bool end) {
+        std::fill(bucket.begin(), bucket.end(), 0);
+        for (int32_t i=0; i<n; ++i) {
+            bucket[s[i]]++;
+        }
+        int32_t sum = 0;
+        for (auto& b : bucket) {
+            sum += b;
+            b = end ? sum : sum - b;
+        }
+    }
+
+    void induceL(const int32_t* s, int32_t* sa, const std::vector<uint8_t>& stype, int32_t n,
+                 std::vector<int32_t>& bucket) {
+        getBuckets(s, n, bucket, false);
+        for (int32_t i=0; i<n; ++i) {
+            int32_t j = sa[i] - 1;
+            if (j >= 0 && !stype[j]) {
+                sa[bucket[s[j]]++] = j;
+            }
+        }
+    }
+
+    void induceS(const int32_t* s, int32_t* sa, const std::vector<uint8_t>& stype, int32_t n,
+                 std::vector<int32_t>& bucket) {
+        getBuckets(s, n, bucket, true);
+        for (int32_t i=n-1; i>=0; --i) {
+            int32_t j = sa[i] - 1;
+            if (j >= 0 && stype[j]) {
+                sa[--bucket[s[j]]] = j;
+            }
+        }
+    }
+
+    // suffix array by induced sorting (SA-IS); s[n-1] must be the unique smallest symbol 0
+    // and every symbol below k. Linear time, the reduced problem reuses sa as storage.
+    void suffixArray(const int32_t* s, int32_t* sa, int32_t n, int32_t k) {
+        std::vector<uint8_t> stype(n);   // 1 marks S-type suffixes
+        stype[n-1] = 1;
+        for (int32_t i=n-2; i>=0; --i) {
+            stype[i] = s[i] < s[i+1] || (s[i]==s[i+1] && stype[i+1]);
+        }
+        auto isLms = [&stype](int32_t i) { return i > 0 && stype[i] && !stype[i-1]; };
+
+        // sort the LMS substrings: drop LMS positions at their bucket tails and induce
+        std::vector<int32_t> bucket(k);
+        getBuckets(s, n, bucket, true);
+        std::fill(sa, sa + n, -1);
+        for (int32_t i=1; i<n; ++i) {
+            if (isLms(i)) {
+                sa[--bucket[s[i]]] = i;
+            }
+        }
+        induceL(s, sa, stype, n, bucket);
+        induceS(s, sa, stype, n, bucket);
+
+        // compact the sorted LMS positions and name each distinct substring
+        int32_t n1 = 0;
+        for (int32_t i=0; i<n; ++i) {
+            if (isLms(sa[i])) {
+                sa[n1++] = sa[i];
+            }
+        }
+        std::fill(sa + n1, sa + n, -1);
+        int32_t name = 0;
+        int32_t prev = -1;
+        for (int32_t i=0; i<n1; ++i) {
+            int32_t pos = sa[i];
+            bool differs = false;
+            for (int32_t d=0; ; ++d) {
+                if (prev < 0 || s[pos+d]!=s[prev+d] || stype[pos+d]!=stype[prev+d]) {
+                    differs = true;
+                    break;
+                }
+                if (d > 0 && (isLms(pos+d) || isLms(prev+d))) {
+                    break;
+                }
+            }
+            if (differs) {
+                name++;
+                prev = pos;
+            }
+            sa[n1 + pos / 2] = name - 1;
+        }
+        for (int32_t i=n-1, j=n-1; i>=n1; --i) {
+            if (sa[i] >= 0) {
+                sa[j--] = sa[i];
+            }
+        }
+
+        // order the LMS suffixes, recursing only when two substrings share a name
+        int32_t* s1 = sa + n - n1;
+        if (name < n1) {
+            suffixArray(s1, sa, n1, name);
+        }
+        else {
+            for (int32_t i=0; i<n1; ++i) {
+                sa[s1[i]] = i;
+            }
+        }
+
+        // induce the full order from the sorted LMS suffixes
+        getBuckets(s, n, bucket, true);
+        for (int32_t i=1, j=0; i<n; ++i) {
+            if (isLms(i)) {
+                s1[j++] = i;
+            }
+        }
+        for (int32_t i=0; i<n1; ++i) {
+            sa[i] = s1[sa[i]];
+        }
+        std::fill(sa + n1, sa + n, -1);
+        for (int32_t i=n1-1; i>=0; --i) {
+            int32_t j = sa[i];
+            sa[i] = -1;
+            sa[--bucket[s[j]]] = j;
+        }
+        induceL(s, sa, stype, n, bucket);
+        induceS(s, sa, stype, n, bucket);
+    }
+}
+
+BlockSort::BlockSort(std::unique_ptr<Compressor> entropy_coder)
+    : entropy_coder(std::move(entropy_coder)) {
+    if (!this->entropy_coder) {
+        throw std::invalid_argument("BlockSort needs an entropy coder");
+    }
+}
+
+uint32_t BlockSort::transform(std::span<const uint8_t> block, std::span<uint8_t> out, std::vector<int32_t>& scratch) {
+    if (block.size() > kBlockSize) {
+        throw std::invalid_argument("Block is larger than kBlockSize");
+    }
+    const int32_t n = static_cast<int32_t>(block.size());
+    if (n==0) return 0;
+
+    // bytes shifted up by one so 0 can be the end marker
+    scratch.resize(2 * (n + 1));
+    int32_t* text = scratch.data();
+    int32_t* sa = text + n + 1;
+    for (int32_t i=0; i<n; ++i) {
+        text[i] = block[i] + 1;
+    }
+    text[n] = 0;
+    suffixArray(text, sa, n + 1, 257);
+
+    // last column of the sorted rotations, the end marker's row is only remembered
+    uint32_t primary = 0;
+    size_t j = 0;
+    for (int32_t i=0; i<=n; ++i) {
+        if (sa[i]==0) {
+            primary = i;
+        }
+        else {
+            out[j++] = block[sa[i] - 1];
+        }
+    }
+    return primary;
+}
+
+void BlockSort::inverseTransform(std::span<const uint8_t> bwt, uint32_t primary, std::span<uint8_t> out,
+                                 std::vector<uint32_t>& scratch) {
+    const size_t n = bwt.size();
+    if (n==0) return;
+    if (n > kBlockSize || primary==0 || primary > n) {
+        throw std::runtime_error("Corrupt block sort primary index");
+    }
+
+    // row 0 is the rotation starting with the end marker, byte rows follow in byte order
+    std::array<uint32_t, 256> next{};
+    for (uint8_t c : bwt) {
+        next[c]++;
+    }
+    uint32_t sum = 1;
+    for (auto& count : next) {
+        uint32_t c = count;
+        count = sum;
+        sum += c;
+    }
+
+    // one u32 per row holds the row that follows it and the byte that row emits, so
+    // walking the text is a single dependent load per byte instead of two lookups
+    scratch.resize(n + 1);
+    scratch[0] = primary << 8;
+    for (uint32_t i=0; i<primary; ++i) {
+        scratch[next[bwt[i]]++] = (i << 8) | bwt[i];
+    }
+    for (uint32_t i=primary+1; i<=n; ++i) {
+        scratch[next[bwt[i-1]]++] = (i << 8) | bwt[i-1];
+    }
+
+    uint32_t row = primary;
+    for (size_t k=0; k<n; ++k) {
+        uint32_t link = scratch[row];
+        out[k] = static_cast<uint8_t>(link);
+        row = link >> 8;
+    }
+}
+
+void BlockSort::encodeRanks(std::span<const uint8_t> data, std::vector<uint8_t>& out) {
+    std::array<uint8_t, 256> order;
+    for (int i=0; i<256; ++i) {
+        order[i] = static_cast<uint8_t>(i);
+    }
+
+    uint64_t run = 0;
+    auto flushRun = [&]() {
+        while (run > 0) {
+            if (run & 1) {
+                out.push_back(0);
+                run = (run - 1) / 2;
+            }
+            else {
+                out.push_back(1);
+                run = (run - 2) / 2;
+            }
+        }
+    };
+
+    for (uint8_t byte : data) {
+        if (order[0]==byte) {
+            run++;
+            continue;
+        }
+        flushRun();
+
+        size_t rank = 1;
+        while (order[rank]!=byte) {
+            rank++;
+        }
+        std::copy_backward(order.begin(), order.begin() + rank, order.begin() + rank + 1);
+        order[0] = byte;
+
+        if (rank < 254) {
+            out.push_back(static_cast<uint8_t>(rank + 1));
+        }
+        else {
+            out.push_back(255);
+            out.push_back(static_cast<uint8_t>(rank - 254));
+        }
+    }
+    flushRun();
+}
+
+void BlockSort::decodeRanks(std::span<const uint8_t> ranks, std::span<uint8_t> out) {
+    std::array<uint8_t, 256> order;
+    for (int i=0; i<256; ++i) {
+        order[i] = static_cast<uint8_t>(i);
+    }
+
+    size_t pos = 0;
+    uint64_t run = 0;
+    unsigned int digit = 0;
+    auto flushRun = [&]() {
+        if (run > out.size() - pos) {
+            throw std::runtime_error("Corrupt block sort ranks");
+        }
+        std::fill_n(out.begin() + pos, run, order[0]);
+        pos += run;
+        run = 0;
+        digit = 0;
+    };
+
+    for (size_t i=0; i<ranks.size(); ++i) {
+        uint8_t symbol = ranks[i];
+        if (symbol < 2) {
+            if (digit >= 48) {
+                throw std::runtime_error("Corrupt block sort ranks");
+            }
+            run += static_cast<uint64_t>(symbol + 1) << digit++;
+            continue;
+        }
+        flushRun();
+
+        size_t rank = symbol - 1;
+        if (symbol==255) {
+            if (++i==ranks.size() || ranks[i] > 1) {
+                throw std::runtime_error("Corrupt block sort ranks");
+            }
+            rank = 254 + ranks[i];
+        }
+        if (pos==out.size()) {
+            throw std::runtime_error("Corrupt block sort ranks");
+        }
+        uint8_t byte = order[rank];
+        std::copy_backward(order.begin(), order.begin() + rank, order.begin() + rank + 1);
+        order[0] = byte;
+        out[pos++] = byte;
+    }
+    flushRun();
+
+    if (pos!=out.size()) {
+        throw std::runtime_error("Corrupt block sort ranks");
+    }
+}
+
+size_t BlockSort::compressBound(size_t n) const {
+    // the transformed form is only kept when its ranks are shorter than the chunk
+    return kHeaderSize + 4 * blockCount(n) + entropy_coder->compressBound(n);
+}
+
+Compressor::EncodedData BlockSort::compress(const std::vector<uint8_t>& chunk) {
+    EncodedData encoded;
+    encoded.bits.resize(compressBound(chunk.size()));
+    encoded.bits.resize(compress(chunk, encoded.bits, encoded.padding));
+    return encoded;
+}
+
+size_t BlockSort::compress(std::span<const uint8_t> chunk, std::span<uint8_t> out, uint8_t& padding) {
+    if (out.size() < compressBound(chunk.size())) {
+        throw std::invalid_argument("Output buffer is smaller than compressBound");
+    }
+    if (chunk.size() > std::numeric_limits<uint32_t>::max()) {
+        throw std::invalid_argument("BlockSort chunks are limited to 4 GiB");
+    }
+
+    const size_t blocks = blockCount(chunk.size());
+    bwt.resize(chunk.size());
+    std::vector<uint32_t> primaries(blocks);
+    for (size_t b=0; b<blocks; ++b) {
+        size_t offset = b * kBlockSize;
+        size_t size = std::min(kBlockSize, chunk.size() - offset);
+        primaries[b] = transform(chunk.subspan(offset, size), std::span<uint8_t>(bwt).subspan(offset, size),
+                                 suffix_scratch);
+    }
+    ranks.clear();
+    encodeRanks(bwt, ranks);
+
+    if (ranks.size() >= chunk.size()) {
+        out[0] = Raw;
+        return 1 + entropy_coder->compress(chunk, out.subspan(1), padding);
+    }
+
+    size_t pos = 0;
+    out[pos++] = Transformed;
+    putU32(static_cast<uint32_t>(chunk.size()), out, pos);
+    putU32(static_cast<uint32_t>(ranks.size()), out, pos);
+    for (uint32_t primary : primaries) {
+        putU32(primary, out, pos);
+    }
+    return pos + entropy_coder->compress(ranks, out.subspan(pos), padding);
+}
+
+std::vector<uint8_t> BlockSort::decompress(const EncodedData& chunk) {
+    if (chunk.bits.empty()) {
+        throw std::runtime_error("Empty block sort chunk");
+    }
+    if (chunk.bits[0]==Raw) {
+        EncodedData inner{std::vector<uint8_t>(chunk.bits.begin() + 1, chunk.bits.end()), chunk.padding};
+        return entropy_coder->decompress(inner);
+    }
+
+    size_t pos = 1;
+    std::vector<uint8_t> out(getU32(chunk.bits, pos));
+    decompress(chunk.bits, chunk.padding, out);
+    return out;
+}
+
+size_t BlockSort::decompress(std::span<const uint8_t> bits, uint8_t padding, std::span<uint8_t> out) {
+    if (bits.empty()) {
+        throw std::runtime_error("Empty block sort chunk");
+    }
+    if (bits[0]==Raw) {
+        return entropy_coder->decompress(bits.subspan(1), padding, out);
+    }
+    if (bits[0]!=Transformed) {
+        throw std::runtime_error("Unknown block sort format");
+    }
+
+    size_t pos = 1;
+    size_t size = getU32(bits, pos);
+    size_t rank_count = getU32(bits, pos);
+    if (size > out.size()) {
+        throw std::runtime_error("Decoded chunk is larger than its output buffer");
+    }
+    if (rank_count > 2 * size) {
+        throw std::runtime_error("Corrupt block sort header");
+    }
+    std::vector<uint32_t> primaries(blockCount(size));
+    for (auto& primary : primaries) {
+        primary = getU32(bits, pos);
+    }
+
+    ranks.resize(rank_count);
+    if (entropy_coder->decompress(bits.subspan(pos), padding, ranks)!=rank_count) {
+        throw std::runtime_error("Corrupt block sort ranks");
+    }
+    bwt.resize(size);
+    decodeRanks(ranks, bwt);
+
+    for (size_t b=0; b<primaries.size(); ++b) {
+        size_t offset = b * kBlockSize;
+        size_t block = std::min(kBlockSize, size - offset);
+        inverseTransform(std::span<const uint8_t>(bwt).subspan(offset, block), primaries[b],
+                         out.subspan(offset, block), link_scratch);
+    }
+    return size;
+}
+
+void BlockSort::resetStream() {
+    entropy_coder->resetStream();
+}
+
+size_t BlockSort::decompressBound(std::span<const uint8_t> bits) const {
+    if (bits.empty()) {
+        return 0;
+    }
+    if (bits[0]==Raw) {
+        return entropy_coder->decompressBound(bits.subspan(1));
+    }
+    // zero runs grow exponentially with their digits, only the header bounds the size
+    if (bits[0]!=Transformed || bits.size() < kHeaderSize) {
+        return 0;
+    }
+    size_t pos = 1;
+    return getU32(bits, pos);
+}
+
+bool BlockSort::standsAlone(std::span<const uint8_t> bits) const {
+    // the entropy coder decides, it sees the payload behind the header
+    if (bits.empty() || bits[0]==Raw) {
+        return entropy_coder->standsAlone(bits.empty() ? bits : bits.subspan(1));
+    }
+    if (bits.size() < kHeaderSize) {
+        return true;
+    }
+    size_t pos = 1;
+    size_t payload = kHeaderSize + 4 * blockCount(getU32(bits, pos));
+    return payload > bits.size() || entropy_coder->standsAlone(bits.subspan(payload));
+}
+
+std::unique_ptr<Compressor> BlockSort::clone() const {
+    return std::make_unique<BlockSort>(entropy_coder->clone());
+}
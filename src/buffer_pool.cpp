@@ -0,0 +1,45 @@
+#include "buffer_pool.h"
+#include "numa_topology.h"
+
+std::vector<uint8_t> BufferPool::acquire(size_t size) {
+    std::vector<uint8_t> buffer;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // prefer a buffer that already fits, otherwise grow the most recently released one
+        for (size_t i=0; i<free_buffers.size(); ++i) {
+            if (free_buffers[i].capacity() >= size) {
+                std::swap(free_buffers[i], free_buffers.back());
+                buffer = std::move(free_buffers.back());
+                free_buffers.pop_back();
+                break;
+            }
+        }
+        if (buffer.capacity()==0 && !free_buffers.empty()) {
+            buffer = std::move(free_buffers.back());
+            free_buffers.pop_back();
+        }
+    }
+
+    if (buffer.capacity() < size) {
+        allocations++;
+        // a fresh vector rather than growing this one: growing copies the old contents into
+        // the new pages before they are bound. reserve does not touch them, resize writes them
+        // after the bind
+        buffer = std::vector<uint8_t>();
+        buffer.reserve(size);
+        NumaTopology::bindMemory(buffer.data(), buffer.capacity(), node);
+    }
+    buffer.resize(size);
+    return buffer;
+}
+
+void BufferPool::release(std::vector<uint8_t>&& buffer) {
+    if (buffer.capacity()==0) return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    free_buffers.push_back(std::move(buffer));
+}
+
+size_t BufferPool::getAllocations() const {
+    return allocations;
+}
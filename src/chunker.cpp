@@ -31,4 +31,14 @@ std::vector<Chunker::Chunk> Chunker::split(const std::vector<uint8_t>& input) {
     }
 
     return chunks;
-}
\ No newline at end of file
+}
+
+std::vector<std::span<const uint8_t>> Chunker::view(std::span<const uint8_t> input) const {
+    std::vector<std::span<const uint8_t>> chunks;
+    chunks.reserve((input.size() + chunk_size - 1) / chunk_size);
+
+    for (size_t offset=0; offset<input.size(); offset+=chunk_size) {
+        chunks.push_back(input.subspan(offset, std::min(chunk_size, input.size() - offset)));
+    }
+    return chunks;
+}
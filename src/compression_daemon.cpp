@@ -0,0 +1,646 @@
+#include "compression_daemon.h"
+#include <stdexcept>
+#include <system_error>
+#include <cerrno>
+#include <cstring>
+#include <climits>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+    constexpr size_t kReplyHeaderSize = 1 + 8 + 4;
+
+    using Clock = std::chrono::steady_clock;
+
+    [[noreturn]] void throwErrno(const std::string& what) {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+
+    // Waits of one request on descriptors the client controls. Every wait also watches the
+    // daemon's stop eventfd and gives up at the request's deadline, so a pipe nobody writes
+    // to or drains cannot hold a thread forever. A negative stop_fd waits out the deadline.
+    class RequestIo {
+        public:
+
+        RequestIo(int stop_fd, Clock::time_point deadline) : stop_fd(stop_fd), deadline(deadline) {}
+
+        // returns once fd is ready, hung up or failed; the next call on it tells which
+        void wait(int fd, short events) const {
+            while (true) {
+                auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - Clock::now()).count();
+                if (left <= 0) {
+                    throw std::runtime_error("Request timed out");
+                }
+                pollfd fds[2] = {{fd, events, 0}, {stop_fd, POLLIN, 0}};
+                if (poll(fds, 2, static_cast<int>(std::min<long long>(left, INT_MAX))) < 0) {
+                    if (errno==EINTR) continue;
+                    throwErrno("Could not wait on request descriptors");
+                }
+                if (fds[1].revents) {
+                    throw std::runtime_error("Daemon is stopping");
+                }
+                if (fds[0].revents) return;
+            }
+        }
+
+        private:
+
+        int stop_fd;
+        Clock::time_point deadline;
+    };
+
+    // closes the descriptor it owns
+    struct Descriptor {
+        int fd = -1;
+
+        explicit Descriptor(int fd = -1) : fd(fd) {}
+        ~Descriptor() {
+            if (fd >= 0) close(fd);
+        }
+        Descriptor(const Descriptor&) = delete;
+        Descriptor& operator=(const Descriptor&) = delete;
+    };
+
+    sockaddr_un socketAddress(const std::string& path) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+            throw std::invalid_argument("Socket path must be 1 to " + std::to_string(sizeof(address.sun_path) - 1)
+                                        + " characters: " + path);
+        }
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        return address;
+    }
+
+    void writeAll(int fd, const uint8_t* data, size_t size) {
+        while (size > 0) {
+            ssize_t written = write(fd, data, size);
+            if (written < 0) {
+                if (errno==EINTR) continue;
+                throwErrno("Could not write output");
+            }
+            data += written;
+            size -= written;
+        }
+    }
+
+    void sendAll(int socket, const uint8_t* data, size_t size, const RequestIo& io) {
+        while (size > 0) {
+            ssize_t sent = send(socket, data, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (sent < 0) {
+                if (errno==EINTR) continue;
+                if (errno==EAGAIN || errno==EWOULDBLOCK) {
+                    io.wait(socket, POLLOUT);
+                    continue;
+                }
+                throwErrno("Could not send on daemon socket");
+            }
+            data += sent;
+            size -= sent;
+        }
+    }
+
+    // writes a request's output. Pipes and sockets are written PIPE_BUF bytes at a time once
+    // ready, which never blocks, so a reader that stops draining only runs into the deadline.
+    void writeOutput(int fd, const uint8_t* data, size_t size, const RequestIo& io) {
+        struct stat info{};
+        bool regular = fstat(fd, &info)==0 && S_ISREG(info.st_mode);
+        while (size > 0) {
+            if (!regular) {
+                io.wait(fd, POLLOUT);
+            }
+            ssize_t written = write(fd, data, regular ? size : std::min<size_t>(size, PIPE_BUF));
+            if (written < 0) {
+                if (errno==EINTR) continue;
+                throwErrno("Could not write output");
+            }
+            data += written;
+            size -= written;
+        }
+    }
+
+    // false when the peer closed the connection before the first byte
+    bool receiveAll(int socket, uint8_t* data, size_t size) {
+        size_t received = 0;
+        while (received < size) {
+            ssize_t n = recv(socket, data + received, size - received, 0);
+            if (n < 0) {
+                if (errno==EINTR) continue;
+                throwErrno("Could not receive on daemon socket");
+            }
+            if (n==0) {
+                if (received==0) return false;
+                throw std::runtime_error("Daemon connection closed inside a message");
+            }
+            received += n;
+        }
+        return true;
+    }
+
+    // sends the one byte op with up to two descriptors attached
+    void sendRequest(int socket, uint8_t op, int input, int output) {
+        iovec payload{&op, 1};
+        msghdr message{};
+        message.msg_iov = &payload;
+        message.msg_iovlen = 1;
+
+        alignas(cmsghdr) char control[CMSG_SPACE(2 * sizeof(int))]{};
+        if (input >= 0) {
+            int fds[2] = {input, output};
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+            cmsghdr* header = CMSG_FIRSTHDR(&message);
+            header->cmsg_level = SOL_SOCKET;
+            header->cmsg_type = SCM_RIGHTS;
+            header->cmsg_len = CMSG_LEN(sizeof(fds));
+            std::memcpy(CMSG_DATA(header), fds, sizeof(fds));
+        }
+        while (sendmsg(socket, &message, MSG_NOSIGNAL) < 0) {
+            if (errno!=EINTR) throwErrno("Could not send request to daemon");
+        }
+    }
+
+    enum class Received {
+        Request,
+        Nothing,   // woken without a request, the connection stays open
+        Closed,
+    };
+
+    // reads a request from a connection poll reported readable, without blocking; received
+    // descriptors are owned by input and output
+    Received receiveRequest(int socket, uint8_t& op, Descriptor& input, Descriptor& output) {
+        iovec payload{&op, 1};
+        msghdr message{};
+        message.msg_iov = &payload;
+        message.msg_iovlen = 1;
+        alignas(cmsghdr) char control[CMSG_SPACE(2 * sizeof(int))]{};
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        ssize_t n;
+        while ((n = recvmsg(socket, &message, MSG_CMSG_CLOEXEC | MSG_DONTWAIT)) < 0) {
+            if (errno==EAGAIN || errno==EWOULDBLOCK) return Received::Nothing;
+            if (errno!=EINTR) return Received::Closed;
+        }
+        if (n==0) return Received::Closed;
+
+        for (cmsghdr* header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header)) {
+            if (header->cmsg_level!=SOL_SOCKET || header->cmsg_type!=SCM_RIGHTS) continue;
+            size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            int fds[2] = {-1, -1};
+            std::memcpy(fds, CMSG_DATA(header), std::min<size_t>(count, 2) * sizeof(int));
+            input.fd = fds[0];
+            output.fd = fds[1];
+        }
+        if (message.msg_flags & MSG_CTRUNC) {
+            throw std::runtime_error("Request carried more descriptors than it may");
+        }
+        return Received::Request;
+    }
+
+    std::length_error tooLarge(uint64_t max_size) {
+        return std::length_error("Request is larger than the daemon's limit of " + std::to_string(max_size) + " bytes");
+    }
+
+    // Input of a request. Only memfds sealed against shrinking and writing are mapped: a
+    // client that truncates a mapped file under the daemon would take it down with SIGBUS.
+    // Other regular files are copied with pread, anything else is read through.
+    class RequestInput {
+        public:
+
+        RequestInput(int fd, uint64_t max_size, const RequestIo& io) {
+            struct stat info{};
+            if (fstat(fd, &info) < 0) {
+                throwErrno("Could not stat input");
+            }
+            if (static_cast<uint64_t>(info.st_size) > max_size) {
+                throw tooLarge(max_size);
+            }
+            if (S_ISREG(info.st_mode)) {
+                constexpr int kSealed = F_SEAL_SHRINK | F_SEAL_WRITE;
+                int seals = fcntl(fd, F_GET_SEALS);
+                if (seals >= 0 && (seals & kSealed)==kSealed && info.st_size > 0) {
+                    map_size = info.st_size;
+                    map = mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                    if (map==MAP_FAILED) {
+                        map = nullptr;
+                        throwErrno("Could not map input");
+                    }
+                    return;
+                }
+
+                // the file may still shrink while it is read, keep what was there
+                storage.resize(info.st_size);
+                size_t done = 0;
+                while (done < storage.size()) {
+                    ssize_t n = pread(fd, storage.data() + done, storage.size() - done, done);
+                    if (n < 0) {
+                        if (errno==EINTR) continue;
+                        throwErrno("Could not read input");
+                    }
+                    if (n==0) break;
+                    done += n;
+                }
+                storage.resize(done);
+                return;
+            }
+            uint8_t buffer[64 * 1024];
+            ssize_t n;
+            while (io.wait(fd, POLLIN), (n = read(fd, buffer, sizeof(buffer)))!=0) {
+                if (n < 0) {
+                    if (errno==EINTR) continue;
+                    throwErrno("Could not read input");
+                }
+                if (static_cast<uint64_t>(n) > max_size - storage.size()) {
+                    throw tooLarge(max_size);
+                }
+                storage.insert(storage.end(), buffer, buffer + n);
+            }
+        }
+
+        ~RequestInput() {
+            if (map) munmap(map, map_size);
+        }
+
+        RequestInput(const RequestInput&) = delete;
+        RequestInput& operator=(const RequestInput&) = delete;
+
+        std::span<const uint8_t> bytes() const {
+            return map ? std::span<const uint8_t>(static_cast<const uint8_t*>(map), map_size)
+                       : std::span<const uint8_t>(storage);
+        }
+
+        private:
+
+        void* map = nullptr;
+        size_t map_size = 0;
+        std::vector<uint8_t> storage;
+    };
+}
+
+CompressionDaemon::CompressionDaemon(ThreadedCompressor& compressor, std::string socket_path, size_t connections)
+: compressor(compressor), socket_path(std::move(socket_path)) {
+    if (connections==0) {
+        throw std::invalid_argument("Daemon needs at least one connection thread");
+    }
+    sockaddr_un address = socketAddress(this->socket_path);
+
+    // a socket file nobody answers on is left over from a daemon that died
+    struct stat info{};
+    if (lstat(this->socket_path.c_str(), &info)==0 && S_ISSOCK(info.st_mode)) {
+        Descriptor probe(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+        if (connect(probe.fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address))==0) {
+            throw std::runtime_error("A daemon already listens on " + this->socket_path);
+        }
+        unlink(this->socket_path.c_str());
+    }
+
+    Descriptor stop_event(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+    Descriptor wake_event(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+    if (stop_event.fd < 0 || wake_event.fd < 0) {
+        throwErrno("Could not create daemon events");
+    }
+    Descriptor listener(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0));
+    if (listener.fd < 0) {
+        throwErrno("Could not create daemon socket");
+    }
+    if (bind(listener.fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0
+        || listen(listener.fd, SOMAXCONN) < 0) {
+        throwErrno("Could not listen on " + this->socket_path);
+    }
+    std::swap(listen_fd, listener.fd);
+    std::swap(stop_fd, stop_event.fd);
+    std::swap(wake_fd, wake_event.fd);
+
+    event_thread = std::thread(&CompressionDaemon::eventLoop, this);
+    for (size_t i=0; i<connections; ++i) {
+        handlers.emplace_back(&CompressionDaemon::handlerLoop, this);
+    }
+}
+
+CompressionDaemon::~CompressionDaemon() {
+    stop();
+    event_thread.join();
+    for (auto& thread : handlers) {
+        thread.join();
+    }
+    for (int connection : connections) {
+        close(connection);
+    }
+    close(listen_fd);
+    close(stop_fd);
+    close(wake_fd);
+    unlink(socket_path.c_str());
+}
+
+void CompressionDaemon::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [this]() { return stopping; });
+}
+
+void CompressionDaemon::stop() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stopping) return;
+    stopping = true;
+
+    // the eventfd stays readable, it wakes the event loop and every request waiting on I/O
+    uint64_t one = 1;
+    (void)!write(stop_fd, &one, sizeof(one));
+    cv.notify_all();
+}
+
+size_t CompressionDaemon::requestsServed() const {
+    return requests_served;
+}
+
+void CompressionDaemon::setMaxRequestSize(uint64_t bytes) {
+    if (bytes==0) {
+        throw std::invalid_argument("Request size limit must be at least one byte");
+    }
+    max_request_size = bytes;
+}
+
+void CompressionDaemon::setRequestTimeout(std::chrono::milliseconds timeout) {
+    if (timeout <= std::chrono::milliseconds(0)) {
+        throw std::invalid_argument("Request timeout must be positive");
+    }
+    request_timeout = timeout;
+}
+
+void CompressionDaemon::eventLoop() {
+    std::vector<int> idle;   // connections waiting for their next request
+    std::vector<pollfd> fds;
+    while (true) {
+        fds = {{listen_fd, POLLIN, 0}, {stop_fd, POLLIN, 0}, {wake_fd, POLLIN, 0}};
+        for (int connection : idle) {
+            fds.push_back({connection, POLLIN, 0});
+        }
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno!=EINTR) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            continue;
+        }
+        if (fds[1].revents) break;
+        if (fds[2].revents) {
+            uint64_t count;
+            (void)!read(wake_fd, &count, sizeof(count));
+        }
+
+        std::vector<int> accepted;
+        if (fds[0].revents) {
+            int connection;
+            while ((connection = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC)) >= 0) {
+                accepted.push_back(connection);
+            }
+            // out of descriptors or memory: back off instead of spinning
+            if (errno==EMFILE || errno==ENFILE || errno==ENOBUFS || errno==ENOMEM) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        }
+
+        // connections with a request go to the handlers, the rest keep waiting here
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<int> waiting;
+        for (size_t i=3; i<fds.size(); ++i) {
+            if (fds[i].revents) {
+                ready.push_back(fds[i].fd);
+                cv.notify_one();
+            }
+            else {
+                waiting.push_back(fds[i].fd);
+            }
+        }
+        waiting.insert(waiting.end(), returned.begin(), returned.end());
+        returned.clear();
+        for (int connection : accepted) {
+            connections.insert(connection);
+            waiting.push_back(connection);
+        }
+        idle.swap(waiting);
+    }
+
+    // dropped idle connections see the daemon hang up
+    std::lock_guard<std::mutex> lock(mutex);
+    for (int connection : idle) {
+        connections.erase(connection);
+        close(connection);
+    }
+}
+
+void CompressionDaemon::handlerLoop() {
+    while (true) {
+        int connection;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this]() { return stopping || !ready.empty(); });
+            if (stopping) {
+                for (int queued : ready) {
+                    connections.erase(queued);
+                    close(queued);
+                }
+                ready.clear();
+                return;
+            }
+            connection = ready.front();
+            ready.pop_front();
+        }
+
+        // a broken connection only ends itself
+        bool keep = false;
+        try {
+            keep = serve(connection);
+        }
+        catch (const std::exception&) {
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (keep && !stopping) {
+            returned.push_back(connection);
+            uint64_t one = 1;
+            (void)!write(wake_fd, &one, sizeof(one));
+        }
+        else {
+            connections.erase(connection);
+            close(connection);
+        }
+    }
+}
+
+bool CompressionDaemon::serve(int connection) {
+    uint8_t op = 0;
+    Descriptor input, output;
+    switch (receiveRequest(connection, op, input, output)) {
+        case Received::Nothing: return true;
+        case Received::Closed: return false;
+        case Received::Request: break;
+    }
+    auto deadline = Clock::now() + request_timeout.load();
+
+    Status status = Ok;
+    uint64_t size = 0;
+    std::string message;
+    try {
+        if ((op==Compress || op==Decompress) && input.fd >= 0 && output.fd >= 0) {
+            size = run(static_cast<Op>(op), input.fd, output.fd, deadline);
+        }
+        else if (op!=Stop) {
+            throw std::invalid_argument("Bad daemon request: op " + std::to_string(op));
+        }
+    }
+    catch (const std::exception& e) {
+        status = Failed;
+        message = e.what();
+    }
+
+    std::vector<uint8_t> reply(kReplyHeaderSize);
+    reply[0] = status;
+    for (int i=0; i<8; ++i) {
+        reply[1 + i] = static_cast<uint8_t>(size >> (8 * i));
+    }
+    for (int i=0; i<4; ++i) {
+        reply[9 + i] = static_cast<uint8_t>(message.size() >> (8 * i));
+    }
+    reply.insert(reply.end(), message.begin(), message.end());
+    requests_served++;
+    // the reply still goes out when the daemon is stopping, only the deadline ends it
+    sendAll(connection, reply.data(), reply.size(), RequestIo(-1, deadline));
+
+    if (op==Stop) {
+        stop();
+        return false;
+    }
+    return true;
+}
+
+uint64_t CompressionDaemon::run(Op op, int input, int output, Clock::time_point deadline) {
+    RequestIo io(stop_fd, deadline);
+    const uint64_t max_size = max_request_size;
+    RequestInput request(input, max_size, io);
+    if (op==Decompress && Archive::originalSize(Archive::readIndex(request.bytes())) > max_size) {
+        throw tooLarge(max_size);
+    }
+    auto result = op==Compress ? compressor.compress(request.bytes()) : compressor.decompress(request.bytes());
+    writeOutput(output, result.data(), result.size(), io);
+    return result.size();
+}
+
+DaemonClient::DaemonClient(const std::string& socket_path) {
+    sockaddr_un address = socketAddress(socket_path);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        throwErrno("Could not create client socket");
+    }
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        throwErrno("Could not connect to daemon at " + socket_path);
+    }
+}
+
+DaemonClient::~DaemonClient() {
+    close(fd);
+    if (output_buffer >= 0) close(output_buffer);
+}
+
+std::vector<uint8_t> DaemonClient::compress(std::span<const uint8_t> input) {
+    return roundTrip(CompressionDaemon::Compress, input);
+}
+
+std::vector<uint8_t> DaemonClient::decompress(std::span<const uint8_t> archive) {
+    return roundTrip(CompressionDaemon::Decompress, archive);
+}
+
+uint64_t DaemonClient::compressFile(const std::string& input_path, const std::string& output_path) {
+    return fileToFile(CompressionDaemon::Compress, input_path, output_path);
+}
+
+uint64_t DaemonClient::decompressFile(const std::string& input_path, const std::string& output_path) {
+    return fileToFile(CompressionDaemon::Decompress, input_path, output_path);
+}
+
+void DaemonClient::stopDaemon() {
+    request(CompressionDaemon::Stop, -1, -1);
+}
+
+uint64_t DaemonClient::request(CompressionDaemon::Op op, int input, int output) {
+    sendRequest(fd, op, input, output);
+
+    uint8_t header[kReplyHeaderSize];
+    if (!receiveAll(fd, header, sizeof(header))) {
+        throw std::runtime_error("Daemon closed the connection");
+    }
+    uint64_t size = 0;
+    for (int i=0; i<8; ++i) {
+        size |= static_cast<uint64_t>(header[1 + i]) << (8 * i);
+    }
+    uint32_t message_size = 0;
+    for (int i=0; i<4; ++i) {
+        message_size |= static_cast<uint32_t>(header[9 + i]) << (8 * i);
+    }
+    std::string message(message_size, '\0');
+    if (message_size > 0 && !receiveAll(fd, reinterpret_cast<uint8_t*>(message.data()), message_size)) {
+        throw std::runtime_error("Daemon closed the connection");
+    }
+    if (header[0]!=CompressionDaemon::Ok) {
+        throw std::runtime_error("Daemon: " + message);
+    }
+    return size;
+}
+
+std::vector<uint8_t> DaemonClient::roundTrip(CompressionDaemon::Op op, std::span<const uint8_t> data) {
+    // the daemon maps only inputs that can no longer change, so every request seals a new
+    // input memfd; the output buffer lives as long as the connection
+    Descriptor input(memfd_create("mtc-input", MFD_CLOEXEC | MFD_ALLOW_SEALING));
+    if (input.fd < 0) {
+        throwErrno("Could not create request buffers");
+    }
+    writeAll(input.fd, data.data(), data.size());
+    if (fcntl(input.fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) < 0) {
+        throwErrno("Could not seal request input");
+    }
+    if (output_buffer < 0) {
+        output_buffer = memfd_create("mtc-output", MFD_CLOEXEC);
+        if (output_buffer < 0) {
+            throwErrno("Could not create request buffers");
+        }
+    }
+    if (ftruncate(output_buffer, 0) < 0 || lseek(output_buffer, 0, SEEK_SET) < 0) {
+        throwErrno("Could not reset request buffers");
+    }
+
+    std::vector<uint8_t> result(request(op, input.fd, output_buffer));
+    size_t done = 0;
+    while (done < result.size()) {
+        ssize_t n = pread(output_buffer, result.data() + done, result.size() - done, done);
+        if (n < 0) {
+            if (errno==EINTR) continue;
+            throwErrno("Could not read daemon output");
+        }
+        if (n==0) {
+            throw std::runtime_error("Daemon output is shorter than it reported");
+        }
+        done += n;
+    }
+    return result;
+}
+
+uint64_t DaemonClient::fileToFile(CompressionDaemon::Op op, const std::string& input_path,
+                                  const std::string& output_path) {
+    Descriptor input(open(input_path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (input.fd < 0) {
+        throwErrno("Could not open " + input_path);
+    }
+    Descriptor output(open(output_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+    if (output.fd < 0) {
+        throwErrno("Could not open " + output_path);
+    }
+    return request(op, input.fd, output.fd);
+}
@@ -0,0 +1,404 @@
+#include "context_coder.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+#include <limits>
+
+namespace {
+    // table count, context map when there is a choice, then mask and lengths per table
+    size_t headerBits(size_t tables, const std::array<std::array<uint8_t, 256>, ContextCoder::kMaxTables>& lengths) {
+        size_t bits = 8 + (tables > 1 ? 4 * 256 : 0);
+        for (size_t t=0; t<tables; ++t) {
+            size_t present = std::count_if(lengths[t].begin(), lengths[t].end(), [](uint8_t l) { return l > 0; });
+            bits += 256 + (4 * present + 7) / 8 * 8;
+        }
+        return bits;
+    }
+}
+
+void ContextCoder::buildLengths(const std::array<uint32_t, 256>& freq, std::array<uint8_t, 256>& lengths) {
+    lengths.fill(0);
+    std::array<uint64_t, 256> weight;
+    size_t symbols = 0;
+    for (size_t s=0; s<256; ++s) {
+        weight[s] = freq[s];
+        symbols += freq[s] > 0;
+    }
+    if (symbols==0) return;
+    if (symbols==1) {
+        for (size_t s=0; s<256; ++s) {
+            if (freq[s]) lengths[s] = 1;
+        }
+        return;
+    }
+
+    // nodes 0-255 are leaves, merged nodes follow; parent links give every leaf its depth
+    std::array<int, 511> parent;
+    std::vector<std::pair<uint64_t, int>> heap;
+    heap.reserve(256);
+    auto greater = [](const auto& a, const auto& b) { return a.first > b.first; };
+    while (true) {
+        heap.clear();
+        for (int s=0; s<256; ++s) {
+            if (weight[s]) heap.emplace_back(weight[s], s);
+        }
+        std::make_heap(heap.begin(), heap.end(), greater);
+
+        int next = 256;
+        while (heap.size() > 1) {
+            std::pop_heap(heap.begin(), heap.end(), greater);
+            auto a = heap.back();
+            heap.pop_back();
+            std::pop_heap(heap.begin(), heap.end(), greater);
+            auto b = heap.back();
+            heap.pop_back();
+            parent[a.second] = next;
+            parent[b.second] = next;
+            heap.emplace_back(a.first + b.first, next++);
+            std::push_heap(heap.begin(), heap.end(), greater);
+        }
+        int root = heap.front().second;
+
+        unsigned int longest = 0;
+        for (int s=0; s<256; ++s) {
+            if (!weight[s]) continue;
+            unsigned int depth = 0;
+            for (int node=s; node!=root; node=parent[node]) {
+                depth++;
+            }
+            lengths[s] = static_cast<uint8_t>(depth);
+            longest = std::max(longest, depth);
+        }
+        if (longest <= kMaxCodeLength) return;
+
+        // too deep: flatten the distribution and try again
+        for (auto& w : weight) {
+            if (w) w = 1 + w / 2;
+        }
+    }
+}
+
+uint64_t ContextCoder::plan(std::span<const uint8_t> chunk, size_t max_tables) {
+    if (max_tables==0 || max_tables > kMaxTables) {
+        throw std::invalid_argument("ContextCoder supports 1 to 16 tables");
+    }
+
+    // successor histogram of every previous byte, the first byte follows a virtual 0
+    counts.resize(256);
+    std::array<bool, 256> seen{};
+    std::array<uint32_t, 256> totals{};
+    active.clear();
+    uint8_t prev = 0;
+    for (uint8_t byte : chunk) {
+        if (!seen[prev]) {
+            seen[prev] = true;
+            counts[prev].fill(0);
+            active.push_back(prev);
+        }
+        counts[prev][byte]++;
+        totals[prev]++;
+        prev = byte;
+    }
+    std::sort(active.begin(), active.end(), [&totals](uint8_t a, uint8_t b) {
+        return totals[a]!=totals[b] ? totals[a] > totals[b] : a < b;
+    });
+
+    // sparse copies of the rows, clustering only ever walks the symbols that occur
+    successors.clear();
+    successor_start.assign(1, 0);
+    for (uint8_t ctx : active) {
+        for (int s=0; s<256; ++s) {
+            if (counts[ctx][s]) successors.emplace_back(static_cast<uint8_t>(s), counts[ctx][s]);
+        }
+        successor_start.push_back(successors.size());
+    }
+
+    // more tables fit the data better but cost header bytes, keep the cheapest count
+    uint64_t best = std::numeric_limits<uint64_t>::max();
+    const size_t most = std::max<size_t>(1, std::min(max_tables, active.size()));
+    for (size_t k=1; ; k=std::min(k * 2, most)) {
+        uint64_t bits = cluster(k);
+        if (bits < best) {
+            best = bits;
+            context_map = trial_map;
+            lengths = trial_lengths;
+            table_count = trial_tables;
+        }
+        if (k==most) break;
+    }
+    header_bits = headerBits(table_count, lengths);
+    assignCodes();
+    return best;
+}
+
+uint64_t ContextCoder::cluster(size_t k) {
+    cluster_counts.resize(k);
+    trial_map.fill(0);
+
+    // seed every table with one of the k busiest contexts, then alternate between
+    // assigning contexts to their cheapest table and refitting the tables
+    for (size_t i=0; i<active.size(); ++i) {
+        trial_map[active[i]] = static_cast<uint8_t>(i < k ? i : 0);
+    }
+    std::vector<std::array<float, 256>> cost(k);
+    for (int pass=0; pass<3; ++pass) {
+        for (auto& row : cluster_counts) row.fill(0);
+        for (size_t i=0; i<active.size(); ++i) {
+            if (pass==0 && i >= k) break;
+            auto& row = cluster_counts[trial_map[active[i]]];
+            for (size_t j=successor_start[i]; j<successor_start[i+1]; ++j) {
+                row[successors[j].first] += successors[j].second;
+            }
+        }
+        if (pass==2) break;
+
+        for (size_t t=0; t<k; ++t) {
+            double total = std::accumulate(cluster_counts[t].begin(), cluster_counts[t].end(), 0.0);
+            double log_total = std::log2(total + 1);
+            for (int s=0; s<256; ++s) {
+                // a symbol new to the table costs its code plus roughly a longer table
+                cost[t][s] = cluster_counts[t][s] ? log_total - std::log2(cluster_counts[t][s]) : log_total + 4;
+            }
+        }
+        for (size_t i=0; i<active.size(); ++i) {
+            float best_cost = std::numeric_limits<float>::max();
+            for (size_t t=0; t<k; ++t) {
+                float c = 0;
+                for (size_t j=successor_start[i]; j<successor_start[i+1]; ++j) {
+                    c += successors[j].second * cost[t][successors[j].first];
+                }
+                if (c < best_cost) {
+                    best_cost = c;
+                    trial_map[active[i]] = static_cast<uint8_t>(t);
+                }
+            }
+        }
+    }
+
+    // tables nobody picked are dropped, the rest are renumbered densely
+    std::array<int, kMaxTables> renumber;
+    renumber.fill(-1);
+    size_t used = 0;
+    for (size_t t=0; t<k; ++t) {
+        if (std::any_of(cluster_counts[t].begin(), cluster_counts[t].end(), [](uint32_t c) { return c > 0; })) {
+            renumber[t] = static_cast<int>(used);
+            buildLengths(cluster_counts[t], trial_lengths[used]);
+            used++;
+        }
+    }
+    for (auto& t : trial_map) {
+        t = static_cast<uint8_t>(std::max(renumber[t], 0));
+    }
+    if (used==0) {
+        trial_lengths[0].fill(0);
+        used = 1;
+    }
+    trial_tables = used;
+
+    uint64_t bits = headerBits(used, trial_lengths);
+    for (size_t t=0; t<k; ++t) {
+        if (renumber[t] < 0) continue;
+        for (int s=0; s<256; ++s) {
+            bits += static_cast<uint64_t>(cluster_counts[t][s]) * trial_lengths[renumber[t]][s];
+        }
+    }
+    return bits;
+}
+
+void ContextCoder::assignCodes() {
+    for (size_t t=0; t<table_count; ++t) {
+        // canonical order: shorter codes first, ties by symbol
+        std::array<uint16_t, kMaxCodeLength + 2> next_code{};
+        std::array<uint16_t, kMaxCodeLength + 1> per_length{};
+        for (uint8_t length : lengths[t]) {
+            per_length[length]++;
+        }
+        per_length[0] = 0;
+        uint16_t code = 0;
+        for (unsigned int l=1; l<=kMaxCodeLength; ++l) {
+            code = static_cast<uint16_t>((code + per_length[l - 1]) << 1);
+            next_code[l] = code;
+        }
+        for (int s=0; s<256; ++s) {
+            uint8_t length = lengths[t][s];
+            codes[t][s] = length ? Code{next_code[length]++, length} : Code{};
+        }
+    }
+}
+
+size_t ContextCoder::encode(std::span<const uint8_t> chunk, std::span<uint8_t> out, uint8_t& padding) const {
+    if (out.size() < (header_bits + 7) / 8) return 0;
+
+    size_t pos = 0;
+    out[pos++] = static_cast<uint8_t>(table_count);
+    if (table_count > 1) {
+        for (int ctx=0; ctx<256; ctx+=2) {
+            out[pos++] = static_cast<uint8_t>(context_map[ctx] << 4 | context_map[ctx + 1]);
+        }
+    }
+    for (size_t t=0; t<table_count; ++t) {
+        for (int s=0; s<256; s+=8) {
+            uint8_t mask = 0;
+            for (int b=0; b<8; ++b) {
+                mask |= (lengths[t][s + b] > 0) << (7 - b);
+            }
+            out[pos++] = mask;
+        }
+        bool high = true;
+        for (uint8_t length : lengths[t]) {
+            if (!length) continue;
+            if (high) {
+                out[pos] = static_cast<uint8_t>(length << 4);
+            }
+            else {
+                out[pos++] |= length;
+            }
+            high = !high;
+        }
+        if (!high) pos++;
+    }
+
+    // payload, same most significant first bit order as Huffman::encodeData
+    uint64_t pending = 0;
+    unsigned int bit_count = 0;
+    uint8_t prev = 0;
+    for (uint8_t byte : chunk) {
+        const Code& code = codes[context_map[prev]][byte];
+        if (code.length==0) {
+            throw std::invalid_argument("No context code for byte " + std::to_string(byte));
+        }
+        pending = (pending << code.length) | code.bits;
+        bit_count += code.length;
+        while (bit_count >= 8) {
+            if (pos==out.size()) return 0;
+            bit_count -= 8;
+            out[pos++] = static_cast<uint8_t>(pending >> bit_count);
+        }
+        prev = byte;
+    }
+    padding = 0;
+    if (bit_count > 0) {
+        if (pos==out.size()) return 0;
+        out[pos++] = static_cast<uint8_t>(pending << (8 - bit_count));
+        padding = 8 - bit_count;
+    }
+    return pos;
+}
+
+size_t ContextCoder::readHeader(std::span<const uint8_t> data) {
+    auto need = [&data](size_t end) {
+        if (end > data.size()) {
+            throw std::runtime_error("Corrupt context tables: truncated header");
+        }
+    };
+
+    size_t pos = 0;
+    need(1);
+    table_count = data[pos++];
+    if (table_count==0 || table_count > kMaxTables) {
+        throw std::runtime_error("Corrupt context tables: bad table count");
+    }
+    context_map.fill(0);
+    if (table_count > 1) {
+        need(pos + 128);
+        for (int ctx=0; ctx<256; ctx+=2) {
+            context_map[ctx] = data[pos] >> 4;
+            context_map[ctx + 1] = data[pos++] & 0x0F;
+            if (context_map[ctx] >= table_count || context_map[ctx + 1] >= table_count) {
+                throw std::runtime_error("Corrupt context tables: bad table index");
+            }
+        }
+    }
+
+    decode_table.assign(table_count << kMaxCodeLength, 0);
+    for (size_t t=0; t<table_count; ++t) {
+        need(pos + 32);
+        auto mask = data.subspan(pos, 32);
+        pos += 32;
+        bool high = true;
+        for (int s=0; s<256; ++s) {
+            lengths[t][s] = 0;
+            if (!(mask[s / 8] & (0x80 >> (s % 8)))) continue;
+            need(pos + 1);
+            uint8_t length = high ? data[pos] >> 4 : data[pos++] & 0x0F;
+            high = !high;
+            if (length==0 || length > kMaxCodeLength) {
+                throw std::runtime_error("Corrupt context tables: bad code length");
+            }
+            lengths[t][s] = length;
+        }
+        if (!high) pos++;
+    }
+    assignCodes();
+
+    // every code fills the lookup slots that start with it; a corrupt over-full length set
+    // would spill past its table, so check the Kraft sum first
+    for (size_t t=0; t<table_count; ++t) {
+        uint32_t kraft = 0;
+        for (uint8_t length : lengths[t]) {
+            if (length) kraft += 1u << (kMaxCodeLength - length);
+        }
+        if (kraft > (1u << kMaxCodeLength)) {
+            throw std::runtime_error("Corrupt context tables: code lengths overflow");
+        }
+        uint16_t* table = decode_table.data() + (t << kMaxCodeLength);
+        for (int s=0; s<256; ++s) {
+            const Code& code = codes[t][s];
+            if (!code.length) continue;
+            unsigned int shift = kMaxCodeLength - code.length;
+            std::fill_n(table + (code.bits << shift), 1u << shift, static_cast<uint16_t>(s << 4 | code.length));
+        }
+    }
+    return pos;
+}
+
+template <typename Emit>
+void ContextCoder::decodePayload(std::span<const uint8_t> payload, uint8_t padding, Emit&& emit) const {
+    if (payload.empty()) return;
+    const uint64_t total_bits = payload.size() * 8 - padding;
+
+    // bits are refilled a byte at a time, past the end the reader sees zeros
+    uint64_t buffer = 0;
+    unsigned int buffered = 0;
+    size_t next = 0;
+    uint64_t consumed = 0;
+    uint8_t prev = 0;
+    while (consumed < total_bits) {
+        while (buffered <= 56) {
+            buffer |= static_cast<uint64_t>(next < payload.size() ? payload[next] : 0) << (56 - buffered);
+            next++;
+            buffered += 8;
+        }
+        size_t index = (static_cast<size_t>(context_map[prev]) << kMaxCodeLength) | (buffer >> (64 - kMaxCodeLength));
+        uint16_t entry = decode_table[index];
+        unsigned int length = entry & 0x0F;
+        if (length==0 || consumed + length > total_bits) {
+            throw std::runtime_error("Corrupt context coded payload");
+        }
+        buffer <<= length;
+        buffered -= length;
+        consumed += length;
+        prev = static_cast<uint8_t>(entry >> 4);
+        emit(prev);
+    }
+}
+
+size_t ContextCoder::decode(std::span<const uint8_t> data, uint8_t padding, std::span<uint8_t> out) {
+    size_t start = readHeader(data);
+    size_t pos = 0;
+    decodePayload(data.subspan(start), padding, [&](uint8_t byte) {
+        if (pos==out.size()) {
+            throw std::runtime_error("Decoded chunk is larger than its output buffer");
+        }
+        out[pos++] = byte;
+    });
+    return pos;
+}
+
+std::vector<uint8_t> ContextCoder::decode(std::span<const uint8_t> data, uint8_t padding) {
+    size_t start = readHeader(data);
+    std::vector<uint8_t> out;
+    decodePayload(data.subspan(start), padding, [&out](uint8_t byte) { out.push_back(byte); });
+    return out;
+}
@@ -1,79 +1,106 @@
 #include "huffman.h"
+#include "huffman_dictionary.h"
 #include <functional>
+#include <stdexcept>
+#include <cmath>
+#include <algorithm>
+#include <limits>
 
 // getters
 HuffmanNode* Huffman::getRoot() {
     return root;
 }
 
+unsigned int Huffman::getMaxCodeLength() const {
+    return max_code_length;
+}
+
+HuffmanDecodeTable Huffman::getDecodeTable() const {
+    HuffmanDecodeTable scratch;
+    return decodeTable(scratch);
+}
+
 std::unordered_map<uint8_t, int> Huffman::getFrequencyTable() {
-    return frequency_table;
+    std::unordered_map<uint8_t, int> table;
+    for (size_t b=0; b<frequency_table.size(); ++b) {
+        if (frequency_table[b]) {
+            table[b] = frequency_table[b];
+        }
+    }
+    return table;
 }
     
 std::unordered_map<uint8_t, std::string> Huffman::getHuffmanCodes() {
-    return huffman_codes;
+    std::unordered_map<uint8_t, std::string> table;
+    for (size_t b=0; b<codes.size(); ++b) {
+        for (int i=codes[b].length-1; i>=0; --i) {
+            table[b].push_back((codes[b].bits >> i) & 1 ? '1' : '0');
+        }
+    }
+    return table;
 }
 
 // build table mapping frequencies of each byte
-void Huffman::buildFrequencyTable(const std::vector<uint8_t>& chunk) {
-    frequency_table.clear();
-    frequency_table.reserve(256);
+void Huffman::buildFrequencyTable(std::span<const uint8_t> chunk) {
+    frequency_table.fill(0);
     for (uint8_t b : chunk) {
         frequency_table[b]++;
     }
 }
 
+void Huffman::resetTree() {
+    // reserving the full tree up front keeps node pointers stable and avoids per chunk allocations
+    nodes.clear();
+    nodes.reserve(kMaxNodes);
+    codes.fill({});
+    max_code_length = 0;
+    root = nullptr;
+    codes_sent = false;
+    decode_table_ready = false;
+}
+
 // builds huffman tree from frequency table according to huffman coding algorithm
 void Huffman::buildHuffmanTree() {
+    resetTree();
+    heap.clear();
 
-    std::priority_queue<HuffmanNode*, std::vector<HuffmanNode*>, HuffmanNode::Compare> min_heap;
-
-    //Create leaf nodes and store them in owned_nodes
-    owned_nodes.clear();
-
-    for (const auto& [byte, freq] : frequency_table) {
-        auto node = std::make_unique<HuffmanNode>(byte, freq);
-
-        // raw pointer for the heap
-        HuffmanNode* raw = node.get();
-        min_heap.push(raw);
-
-        // ownership goes into owned_nodes
-        owned_nodes.push_back(std::move(node));
+    //Create leaf nodes in node storage and push them onto the min heap
+    for (size_t b=0; b<frequency_table.size(); ++b) {
+        if (frequency_table[b]==0) continue;
+        nodes.emplace_back(static_cast<uint8_t>(b), frequency_table[b]);
+        heap.push_back(&nodes.back());
+        std::push_heap(heap.begin(), heap.end(), HuffmanNode::Compare());
     }
 
     // Edge case: empty input → no tree
-    if (min_heap.empty()) {
-        root = nullptr;
+    if (heap.empty()) {
         return;
     }
 
     // Build the Huffman tree
-    while (min_heap.size() > 1) {
-        HuffmanNode* left = min_heap.top(); 
-        min_heap.pop();
+    while (heap.size() > 1) {
+        std::pop_heap(heap.begin(), heap.end(), HuffmanNode::Compare());
+        HuffmanNode* left = heap.back();
+        heap.pop_back();
 
-        HuffmanNode* right = min_heap.top(); 
-        min_heap.pop();
+        std::pop_heap(heap.begin(), heap.end(), HuffmanNode::Compare());
+        HuffmanNode* right = heap.back();
+        heap.pop_back();
 
-        auto parent = std::make_unique<HuffmanNode>(
-            0, left->freq + right->freq
-        );
+        nodes.emplace_back(0, left->freq + right->freq);
+        HuffmanNode* parent = &nodes.back();
 
-        // Set children (using raw pointers)
+        // Set children
         parent->left = left;
         parent->right = right;
 
         // Push parent node into heap
-        HuffmanNode* raw_parent = parent.get();
-        min_heap.push(raw_parent);
-
-        // Parent takes ownership in owned_nodes
-        owned_nodes.push_back(std::move(parent));
+        heap.push_back(parent);
+        std::push_heap(heap.begin(), heap.end(), HuffmanNode::Compare());
     }
 
     // The remaining element is the root
-    root = min_heap.top();
+    root = heap.front();
 }
 
 void Huffman::generateCodes(HuffmanNode* node, std::string& current) {
@@ -85,7 +112,13 @@ void Huffman::generateCodes(HuffmanNode* node, std::string& current) {
         if (current.empty()) {
             current.push_back('0');
         }
-        huffman_codes[node->byte] = current;
+        HuffmanCode code;
+        for (char bit : current) {
+            code.bits = (code.bits << 1) | (bit=='1');
+        }
+        code.length = current.size();
+        codes[node->byte] = code;
+        max_code_length = std::max(max_code_length, code.length);
         return;
     }
 
@@ -100,119 +133,357 @@ void Huffman::generateCodes(HuffmanNode* node, std::string& current) {
     current.pop_back();
 }
 
-Compressor::EncodedData Huffman::encodeData(const std::vector<uint8_t>& chunk) {
+Compressor::EncodedData Huffman::encodeData(const std::vector<uint8_t>& chunk) const {
     EncodedData result;
+    encodeData(chunk, result);
+    return result;
+}
 
-    uint8_t current_byte = 0;
-    unsigned int bit_count = 0;
-
-    // loop through all original bytes
-    for (const auto& chunk_byte : chunk) {
-        std::string bit_string = huffman_codes[chunk_byte];
-
-        // compress original bytes according to huffman codes
-        for (size_t i=0; i<bit_string.length(); ++i) {
-            // byte is full so send to output vector
-            if (bit_count==7) {
-                if (bit_string[i]=='1') {
-                    current_byte |= 1;
-                }
-                result.bits.push_back(current_byte);
-                current_byte = 0;
-                bit_count = 0;
-            }
-            // add low or high bit to compressed data and shift current_byte to next bit
-            else {
-                if (bit_string[i]=='1') {
-                    current_byte |= 1;
-                }
-                current_byte <<= 1;
-                bit_count++;
-            }
-        }
+void Huffman::encodeData(const std::vector<uint8_t>& chunk, EncodedData& result) const {
+    size_t offset = result.bits.size();
+    result.bits.resize(offset + encodedBound(chunk.size()));
+    size_t written = encodeData(chunk, std::span<uint8_t>(result.bits).subspan(offset), result.padding);
+    result.bits.resize(offset + written);
+}
+
+size_t Huffman::encodedBound(size_t n) const {
+    return (n * max_code_length + 7) / 8;
+}
+
+size_t Huffman::encodeData(std::span<const uint8_t> chunk, std::span<uint8_t> out, uint8_t& padding) const {
+    return HuffmanKernels::encode(chunk, codes, max_code_length, out, padding);
+}
+
+std::vector<uint8_t> Huffman::decodeData(const EncodedData& data) const {
+    return decodeData(data.bits, data.padding);
+}
+
+const HuffmanDecodeTable& Huffman::decodeTable(HuffmanDecodeTable& scratch) const {
+    if (decode_table_ready) {
+        return decode_table;
     }
-    // leftover bits
-    if (bit_count > 0) {
-        // subtract 1 because current byte it always shifted one ahead of bit count
-        current_byte <<= (8 - bit_count - 1);
-        result.bits.push_back(current_byte);
-        result.padding = 8 - bit_count;
+    HuffmanKernels::buildDecodeTable(root, nodes.data(), scratch);
+    return scratch;
+}
+
+std::vector<uint8_t> Huffman::decodeData(std::span<const uint8_t> bits, uint8_t padding) const {
+    HuffmanDecodeTable scratch;
+    const HuffmanDecodeTable& table = decodeTable(scratch);
+    if (bits.empty()) {
+        return {};
     }
-    return result;
+    // every code is at least min_length bits long
+    std::vector<uint8_t> out((bits.size() * 8) / std::max(table.min_length, 1u));
+    out.resize(HuffmanKernels::decode(bits, padding, table, out));
+    return out;
 }
 
-std::vector<uint8_t> Huffman::decodeData(EncodedData& data) {
-    std::vector<uint8_t> out;
-    uint8_t bit_count = 0;
-    HuffmanNode* current_node = root;
-
-    for (size_t i=0; i<data.bits.size(); ++i) {
-        uint8_t current_byte = data.bits[i];
-        // if last byte decode until we reach padding
-        if (i==data.bits.size()-1) {
-            while (bit_count < (8 - data.padding)) {
-                while (current_node->left && current_node->right && (bit_count < (8 - data.padding))) {
-                    int choice = 0b10000000 & current_byte;
-                    current_byte <<= 1;
-                    if (choice) {
-                        current_node = current_node->right;
-                    }
-                    else {
-                        current_node = current_node->left;
-                    }
-                    bit_count++;
-                }
-                if (bit_count < (8 - data.padding) || (!current_node->left || !current_node->right)) {
-                    out.push_back(current_node->byte);
-                    // handles edge case where root is the only node
-                    if (current_node==root) {
-                        bit_count++;
-                    }
-                    current_node = root;
-                }
-            }
+size_t Huffman::decodeData(std::span<const uint8_t> bits, uint8_t padding, std::span<uint8_t> out) const {
+    // a table built by prepareDecoder or loadTree saves clearing a scratch table per chunk
+    if (decode_table_ready) {
+        return HuffmanKernels::decode(bits, padding, decode_table, out);
+    }
+    HuffmanDecodeTable scratch;
+    return HuffmanKernels::decode(bits, padding, decodeTable(scratch), out);
+}
+
+void Huffman::serializeTree(const HuffmanNode* node, std::vector<uint8_t>& out) {
+    if (!node) return;
+
+    if (!node->left && !node->right) {
+        out.push_back(1);
+        out.push_back(node->byte);
+        return;
+    }
+    out.push_back(0);
+    serializeTree(node->left, out);
+    serializeTree(node->right, out);
+}
+
+void Huffman::writeTree(const HuffmanNode* node, std::span<uint8_t> out, size_t& pos) const {
+    if (!node) return;
+
+    if (!node->left && !node->right) {
+        out[pos++] = 1;
+        out[pos++] = node->byte;
+        return;
+    }
+    out[pos++] = 0;
+    writeTree(node->left, out, pos);
+    writeTree(node->right, out, pos);
+}
+
+HuffmanNode* Huffman::deserializeTree(std::span<const uint8_t> data, size_t& index) {
+    if (index >= data.size()) {
+        throw std::runtime_error("Corrupt huffman tree: unexpected end of data");
+    }
+    if (nodes.size() >= kMaxNodes) {
+        throw std::runtime_error("Corrupt huffman tree: too many nodes");
+    }
+
+    uint8_t marker = data[index++];
+    if (marker==1) {
+        if (index >= data.size()) {
+            throw std::runtime_error("Corrupt huffman tree: leaf without byte");
         }
-        // else decode until we reach end of byte
-        else {
-            while (bit_count < 8) {
-                while (current_node->left && current_node->right && (bit_count < 8)) {
-                    int choice = 0b10000000 & current_byte;
-                    current_byte <<= 1;
-                    if (choice) {
-                        current_node = current_node->right;
-                    }
-                    else {
-                        current_node = current_node->left;
-                    }
-                    bit_count++;
-                }
-                if (bit_count < 8 || (!current_node->left || !current_node->right)) {
-                    out.push_back(current_node->byte);
-                    // handles edge case where root is the only node
-                    if (current_node==root) {
-                        bit_count++;
-                    }
-                    current_node = root;
-                }
-            }
-            bit_count = 0;
+        nodes.emplace_back(data[index++], 0);
+        return &nodes.back();
+    }
+    if (marker!=0) {
+        throw std::runtime_error("Corrupt huffman tree: bad node marker");
+    }
+
+    nodes.emplace_back(0, 0);
+    HuffmanNode* parent = &nodes.back();
+    parent->left = deserializeTree(data, index);
+    parent->right = deserializeTree(data, index);
+    return parent;
+}
+
+void Huffman::loadTree(const std::vector<uint8_t>& serialized) {
+    resetTree();
+    if (serialized.empty()) return;
+
+    size_t index = 0;
+    root = deserializeTree(serialized, index);
+    std::string start;
+    generateCodes(root, start);
+    HuffmanKernels::buildDecodeTable(root, nodes.data(), decode_table);
+    decode_table_ready = true;
+}
+
+void Huffman::addDictionary(std::shared_ptr<const HuffmanDictionary> dictionary) {
+    if (!dictionary) {
+        throw std::invalid_argument("Dictionary must not be null");
+    }
+    if (!dictionaries.emplace(dictionary->getId(), dictionary).second) {
+        throw std::invalid_argument("Duplicate dictionary id: " + std::to_string(dictionary->getId()));
+    }
+}
+
+void Huffman::setContextTables(size_t max_tables) {
+    if (max_tables==0 || max_tables > ContextCoder::kMaxTables) {
+        throw std::invalid_argument("Context tables must be between 1 and " + std::to_string(ContextCoder::kMaxTables));
+    }
+    context_tables = max_tables;
+}
+
+void Huffman::setTableReuse(double max_penalty) {
+    if (!(max_penalty >= 0)) {
+        throw std::invalid_argument("Table reuse penalty must not be negative");
+    }
+    reuse_penalty = max_penalty;
+}
+
+uint64_t Huffman::customTableLowerBound() const {
+    // huffman codes can never beat the order-0 entropy of the chunk
+    double total = 0;
+    size_t symbols = 0;
+    for (uint32_t freq : frequency_table) {
+        total += freq;
+        symbols += freq > 0;
+    }
+    double bits = 0;
+    for (uint32_t freq : frequency_table) {
+        if (freq) {
+            bits += freq * std::log2(total / freq);
         }
     }
-    return out;
+    // kind byte + 2 bytes per leaf + 1 byte per internal node
+    uint64_t header_bytes = symbols ? 3 * symbols : 1;
+    return header_bytes * 8 + static_cast<uint64_t>(bits);
 }
 
 // override compression interface functions
- Compressor::EncodedData Huffman::compress(const std::vector<uint8_t>& chunk) {
+size_t Huffman::compressBound(size_t n) const {
+    // a chunk's own huffman codes never beat 8 bits per byte, and a static table is only
+    // chosen when it is cheaper than that
+    return 1 + kMaxTreeBytes + n;
+}
+
+Compressor::EncodedData Huffman::compress(const std::vector<uint8_t>& chunk) {
+    EncodedData encoded;
+    encoded.bits.resize(compressBound(chunk.size()));
+    encoded.bits.resize(compress(chunk, encoded.bits, encoded.padding));
+    return encoded;
+}
+
+size_t Huffman::compress(std::span<const uint8_t> chunk, std::span<uint8_t> out, uint8_t& padding) {
+    if (out.size() < compressBound(chunk.size())) {
+        throw std::invalid_argument("Output buffer is smaller than compressBound");
+    }
     buildFrequencyTable(chunk);
+
+    // cheapest static table for this histogram, counted with its kind and id bytes
+    const HuffmanDictionary* best_static = nullptr;
+    uint64_t static_bits = 0;
+    for (const auto& [id, dictionary] : dictionaries) {
+        uint64_t bits = 16 + dictionary->encodedBits(frequency_table);
+        if (!best_static || bits < static_bits) {
+            best_static = dictionary.get();
+            static_bits = bits;
+        }
+    }
+
+    auto encodeStatic = [&]() {
+        out[0] = StaticTable;
+        out[1] = best_static->getId();
+        return 2 + best_static->getCoder().encodeData(chunk, out.subspan(2), padding);
+    };
+
+    // the stream's previous table, when it codes every byte of this chunk cheaply enough;
+    // neither a tree nor previous-byte tables get built then. The bound only matters when
+    // there is something to compare a custom table with, small chunks skip its logarithms.
+    bool can_repeat = reuse_penalty >= 0 && codes_sent && !chunk.empty();
+    uint64_t custom_lower_bound = best_static || can_repeat || context_tables > 1 ? customTableLowerBound() : 0;
+    if (can_repeat) {
+        uint64_t repeat_bits = 8;
+        for (size_t b=0; b<frequency_table.size() && repeat_bits!=std::numeric_limits<uint64_t>::max(); ++b) {
+            if (frequency_table[b]) {
+                repeat_bits = codes[b].length
+                    ? repeat_bits + static_cast<uint64_t>(frequency_table[b]) * codes[b].length
+                    : std::numeric_limits<uint64_t>::max();
+            }
+        }
+        if (repeat_bits <= custom_lower_bound * (1 + reuse_penalty) && (!best_static || repeat_bits <= static_bits)
+            && repeat_bits <= 8 * compressBound(chunk.size())) {
+            out[0] = RepeatTable;
+            return 1 + encodeData(chunk, out.subspan(1), padding);
+        }
+    }
+
+    // exact size with previous-byte tables, counted with the kind byte
+    uint64_t context_bits = std::numeric_limits<uint64_t>::max();
+    if (context_tables > 1 && !chunk.empty()) {
+        context_bits = 8 + context_coder.plan(chunk, context_tables);
+    }
+    auto encodeContext = [&]() -> size_t {
+        out[0] = ContextTables;
+        size_t written = context_coder.encode(chunk, out.subspan(1), padding);
+        return written ? 1 + written : 0;
+    };
+
+    // skip building a custom tree when no custom tree could beat the alternatives
+    if (best_static && static_bits <= custom_lower_bound && static_bits <= context_bits) {
+        return encodeStatic();
+    }
+    if (context_bits < custom_lower_bound && (!best_static || context_bits < static_bits)) {
+        if (size_t written = encodeContext()) {
+            return written;
+        }
+    }
+
     buildHuffmanTree();
-    std::string start;
-    generateCodes(getRoot(), start);
+    if (code_path.capacity() < 64) {
+        code_path.reserve(64);
+    }
+    code_path.clear();
+    generateCodes(getRoot(), code_path);
 
-    auto encoded = encodeData(chunk);
-    return encoded;
+    if (best_static || context_bits!=std::numeric_limits<uint64_t>::max()) {
+        // kind byte + 2 bytes per leaf + 1 byte per internal node, then the payload
+        uint64_t custom_bits = 0;
+        for (size_t b=0; b<frequency_table.size(); ++b) {
+            if (frequency_table[b]) {
+                custom_bits += static_cast<uint64_t>(frequency_table[b]) * codes[b].length + 24;
+            }
+        }
+        if (best_static && static_bits < custom_bits && static_bits <= context_bits) {
+            return encodeStatic();
+        }
+        if (context_bits < custom_bits && (!best_static || context_bits < static_bits)) {
+            if (size_t written = encodeContext()) {
+                return written;
+            }
+        }
+    }
+
+    size_t pos = 0;
+    out[pos++] = CustomTable;
+    writeTree(getRoot(), out, pos);
+    codes_sent = true;
+    return pos + encodeData(chunk, out.subspan(pos), padding);
 }
 
-std::vector<uint8_t> Huffman::decompress(Compressor::EncodedData& chunk) {
-    auto decoded = decodeData(chunk);
+const Huffman& Huffman::prepareDecoder(std::span<const uint8_t> bits, size_t& index) {
+    if (bits.empty()) {
+        throw std::runtime_error("Compressed chunk is missing its table header");
+    }
+
+    if (bits[0]==StaticTable) {
+        if (bits.size() < 2) {
+            throw std::runtime_error("Compressed chunk is missing its dictionary id");
+        }
+        auto it = dictionaries.find(bits[1]);
+        if (it==dictionaries.end()) {
+            throw std::runtime_error("Unknown dictionary id: " + std::to_string(bits[1]));
+        }
+        index = 2;
+        return it->second->getCoder();
+    }
+    if (bits[0]==RepeatTable) {
+        if (!root) {
+            throw std::runtime_error("Repeat table chunk without a previous table in the stream");
+        }
+        index = 1;
+        return *this;
+    }
+    if (bits[0]!=CustomTable) {
+        throw std::runtime_error("Unknown table kind: " + std::to_string(bits[0]));
+    }
+
+    // empty chunk has no tree and no payload
+    resetTree();
+    index = 1;
+    if (index < bits.size()) {
+        root = deserializeTree(bits, index);
+        HuffmanKernels::buildDecodeTable(root, nodes.data(), decode_table);
+        decode_table_ready = true;
+    }
+    return *this;
+}
+
+std::vector<uint8_t> Huffman::decompress(const Compressor::EncodedData& chunk) {
+    if (!chunk.bits.empty() && chunk.bits[0]==ContextTables) {
+        return context_coder.decode(std::span<const uint8_t>(chunk.bits).subspan(1), chunk.padding);
+    }
+    size_t index = 0;
+    const Huffman& decoder = prepareDecoder(chunk.bits, index);
+    auto decoded = decoder.decodeData(std::span<const uint8_t>(chunk.bits).subspan(index), chunk.padding);
     return decoded;
-}
\ No newline at end of file
+}
+
+size_t Huffman::decompress(std::span<const uint8_t> bits, uint8_t padding, std::span<uint8_t> out) {
+    if (!bits.empty() && bits[0]==ContextTables) {
+        return context_coder.decode(bits.subspan(1), padding, out);
+    }
+    size_t index = 0;
+    const Huffman& decoder = prepareDecoder(bits, index);
+    return decoder.decodeData(bits.subspan(index), padding, out);
+}
+
+size_t Huffman::decompressBound(std::span<const uint8_t> bits) const {
+    // every table kind spends at least one bit per byte
+    return bits.size() * 8;
+}
+
+void Huffman::resetStream() {
+    resetTree();
+}
+
+bool Huffman::standsAlone(std::span<const uint8_t> bits) const {
+    // static and context chunks decode alone but leave the stream's table in place, a
+    // repeat chunk after them still refers to the custom table before; only a custom
+    // table starts a run that cannot look back
+    return bits.empty() || bits[0]==CustomTable;
+}
+
+std::unique_ptr<Compressor> Huffman::clone() const {
+    auto copy = std::make_unique<Huffman>();
+    copy->context_tables = context_tables;
+    copy->reuse_penalty = reuse_penalty;
+    for (const auto& [id, dictionary] : dictionaries) {
+        copy->addDictionary(dictionary);
+    }
+    return copy;
+}
@@ -0,0 +1,101 @@
+#include "huffman_dictionary.h"
+#include "file_io.h"
+#include <stdexcept>
+
+namespace {
+    constexpr uint8_t kMagic[4] = {'M', 'T', 'C', 'D'};
+}
+
+HuffmanDictionary::HuffmanDictionary(uint8_t id, std::string name, std::vector<uint8_t> tree)
+    : id(id), name(std::move(name)), tree(std::move(tree)) {
+    // the serialized form stores the name length in one byte
+    if (this->name.size() > kMaxNameLength) {
+        throw std::invalid_argument("Dictionary name is longer than " + std::to_string(kMaxNameLength) + " bytes");
+    }
+    coder.loadTree(this->tree);
+    if (coder.getMaxCodeLength() > kMaxCodeLength) {
+        throw std::invalid_argument("Dictionary " + this->name + " has codes longer than "
+                                    + std::to_string(kMaxCodeLength) + " bits");
+    }
+    for (const auto& [byte, code] : coder.getHuffmanCodes()) {
+        code_lengths[byte] = code.size();
+    }
+    for (size_t b=0; b<code_lengths.size(); ++b) {
+        if (code_lengths[b]==0) {
+            throw std::invalid_argument("Dictionary " + this->name + " has no code for byte " + std::to_string(b));
+        }
+    }
+}
+
+std::shared_ptr<HuffmanDictionary> HuffmanDictionary::train(uint8_t id, const std::string& name,
+                                                            const std::vector<std::vector<uint8_t>>& samples) {
+    std::vector<uint8_t> corpus;
+    for (const auto& sample : samples) {
+        corpus.insert(corpus.end(), sample.begin(), sample.end());
+    }
+
+    // every byte needs a code, so seed the corpus with one occurrence of each value
+    for (size_t b=0; b<256; ++b) {
+        corpus.push_back(static_cast<uint8_t>(b));
+    }
+
+    Huffman trainer;
+    trainer.buildFrequencyTable(corpus);
+    trainer.buildHuffmanTree();
+
+    std::vector<uint8_t> tree;
+    trainer.serializeTree(trainer.getRoot(), tree);
+    return std::make_shared<HuffmanDictionary>(id, name, std::move(tree));
+}
+
+std::vector<uint8_t> HuffmanDictionary::serialize() const {
+    std::vector<uint8_t> out(std::begin(kMagic), std::end(kMagic));
+    out.push_back(id);
+    out.push_back(static_cast<uint8_t>(name.size()));
+    out.insert(out.end(), name.begin(), name.end());
+    out.insert(out.end(), tree.begin(), tree.end());
+    return out;
+}
+
+std::shared_ptr<HuffmanDictionary> HuffmanDictionary::deserialize(const std::vector<uint8_t>& data) {
+    if (data.size() < 6 || !std::equal(std::begin(kMagic), std::end(kMagic), data.begin())) {
+        throw std::runtime_error("Not a huffman dictionary");
+    }
+    uint8_t id = data[4];
+    size_t name_length = data[5];
+    if (data.size() < 6 + name_length) {
+        throw std::runtime_error("Truncated huffman dictionary");
+    }
+    std::string name(data.begin() + 6, data.begin() + 6 + name_length);
+    std::vector<uint8_t> tree(data.begin() + 6 + name_length, data.end());
+    return std::make_shared<HuffmanDictionary>(id, std::move(name), std::move(tree));
+}
+
+void HuffmanDictionary::save(const std::string& fileName) const {
+    FileIO::writeFile(fileName, serialize());
+}
+
+std::shared_ptr<HuffmanDictionary> HuffmanDictionary::load(const std::string& fileName) {
+    return deserialize(FileIO::readFile(fileName));
+}
+
+uint64_t HuffmanDictionary::encodedBits(const std::array<uint32_t, 256>& frequencies) const {
+    uint64_t bits = 0;
+    for (size_t b=0; b<frequencies.size(); ++b) {
+        bits += static_cast<uint64_t>(frequencies[b]) * code_lengths[b];
+    }
+    return bits;
+}
+
+// getters
+uint8_t HuffmanDictionary::getId() const {
+    return id;
+}
+
+const std::string& HuffmanDictionary::getName() const {
+    return name;
+}
+
+const Huffman& HuffmanDictionary::getCoder() const {
+    return coder;
+}
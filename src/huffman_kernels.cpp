@@ -0,0 +1,360 @@
+#include "huffman_kernels.h"
+#include "huffman.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define MTC_HAVE_BMI2_KERNELS
+#endif
+
+namespace {
+    constexpr unsigned int kTableBits = HuffmanDecodeTable::kTableBits;
+
+    // longest code each encode variant handles, it moves 56 / length codes per 64 bit flush
+    constexpr std::array<unsigned int, 6> kEncodeLengths = {8, 11, 14, 18, 28, 56};
+
+    // decode variants: up to 8 and up to kTableBits resolve every code in one lookup, 56 walks
+    // the tree for codes longer than the table
+    constexpr std::array<unsigned int, 3> kDecodeLengths = {8, kTableBits, 56};
+
+    // variant index for every longest code length up to 56
+    template <size_t N>
+    constexpr std::array<uint8_t, 57> variantByLength(const std::array<unsigned int, N>& lengths) {
+        std::array<uint8_t, 57> variant{};
+        for (unsigned int length=0; length<variant.size(); ++length) {
+            while (lengths[variant[length]] < length) {
+                variant[length]++;
+            }
+        }
+        return variant;
+    }
+    constexpr auto kEncodeVariant = variantByLength(kEncodeLengths);
+    constexpr auto kDecodeVariant = variantByLength(kDecodeLengths);
+
+    inline uint64_t loadBigEndian(const uint8_t* p) {
+        uint64_t value;
+        std::memcpy(&value, p, sizeof(value));
+        if constexpr (std::endian::native==std::endian::little) {
+            value = __builtin_bswap64(value);
+        }
+        return value;
+    }
+
+    inline void storeBigEndian(uint8_t* p, uint64_t value) {
+        if constexpr (std::endian::native==std::endian::little) {
+            value = __builtin_bswap64(value);
+        }
+        std::memcpy(p, &value, sizeof(value));
+    }
+
+    [[noreturn]] void throwMissingCode(std::span<const uint8_t> chunk, const std::array<HuffmanCode, 256>& codes) {
+        for (uint8_t byte : chunk) {
+            if (codes[byte].length==0) {
+                throw std::invalid_argument("No huffman code for byte " + std::to_string(byte));
+            }
+        }
+        throw std::logic_error("Missing huffman code reported for a chunk that has every code");
+    }
+
+    // byte at a time encoding of whatever the unrolled loop left, codes of any length
+    size_t encodeTail(std::span<const uint8_t> chunk, const std::array<HuffmanCode, 256>& codes,
+                      std::span<uint8_t> out, size_t pos, uint64_t pending, unsigned int bit_count, uint8_t& padding) {
+        auto put = [&](uint64_t bits, unsigned int length) {
+            pending = (pending << length) | bits;
+            bit_count += length;
+            while (bit_count >= 8) {
+                bit_count -= 8;
+                out[pos++] = static_cast<uint8_t>(pending >> bit_count);
+            }
+        };
+
+        for (uint8_t chunk_byte : chunk) {
+            const HuffmanCode& code = codes[chunk_byte];
+            if (code.length==0) {
+                throw std::invalid_argument("No huffman code for byte " + std::to_string(chunk_byte));
+            }
+            // fewer than 8 bits are ever pending, so codes up to 56 bits fit in one step
+            if (code.length > 56) {
+                put(code.bits >> 32, code.length - 32);
+                put(code.bits & 0xFFFFFFFF, 32);
+            }
+            else {
+                put(code.bits, code.length);
+            }
+        }
+
+        // leftover bits
+        padding = 0;
+        if (bit_count > 0) {
+            out[pos++] = static_cast<uint8_t>(pending << (8 - bit_count));
+            padding = 8 - bit_count;
+        }
+        return pos;
+    }
+
+    template <size_t... K>
+    [[gnu::always_inline]] inline void encodeGroup(const uint8_t* chunk, const std::array<HuffmanCode, 256>& codes,
+                                                   uint64_t& pending, unsigned int& bit_count, bool& missing,
+                                                   std::index_sequence<K...>) {
+        ((pending = (pending << codes[chunk[K]].length) | codes[chunk[K]].bits,
+          bit_count += codes[chunk[K]].length,
+          missing |= codes[chunk[K]].length==0), ...);
+    }
+
+    template <unsigned int MaxLength>
+    [[gnu::always_inline]] inline size_t encodeBody(std::span<const uint8_t> chunk, const std::array<HuffmanCode, 256>& codes,
+                                                    std::span<uint8_t> out, uint8_t& padding) {
+        // fewer than 8 bits stay pending after a flush, so a group never overflows 63 bits
+        constexpr unsigned int group = 56 / MaxLength;
+        uint64_t pending = 0;
+        unsigned int bit_count = 0;
+        size_t pos = 0;
+        size_t i = 0;
+        bool missing = false;
+
+        // every flush stores 8 bytes and keeps the whole ones
+        while (i + group <= chunk.size() && pos + 8 <= out.size()) {
+            encodeGroup(chunk.data() + i, codes, pending, bit_count, missing, std::make_index_sequence<group>{});
+            i += group;
+            storeBigEndian(out.data() + pos, (pending << (63 - bit_count)) << 1);
+            pos += bit_count >> 3;
+            bit_count &= 7;
+        }
+        if (missing) {
+            throwMissingCode(chunk, codes);
+        }
+        return encodeTail(chunk.subspan(i), codes, out, pos, pending, bit_count, padding);
+    }
+
+    // up to 64 bits from bit pos on, zero past the end of data
+    uint64_t peekBits(std::span<const uint8_t> data, uint64_t bit_pos) {
+        uint64_t window = 0;
+        size_t byte = bit_pos >> 3;
+        for (size_t i=0; i<8; ++i) {
+            window = (window << 8) | (byte + i < data.size() ? data[byte + i] : 0);
+        }
+        return window << (bit_pos & 7);
+    }
+
+    // bounds checked decoding of the last bytes of a payload, codes of any length
+    size_t decodeTail(std::span<const uint8_t> bits, uint64_t total_bits, uint64_t bit_pos,
+                      const HuffmanDecodeTable& table, std::span<uint8_t> out, size_t pos) {
+        while (bit_pos < total_bits) {
+            uint16_t entry = table.entries[peekBits(bits, bit_pos) >> (64 - kTableBits)];
+            unsigned int length = entry >> 8;
+            uint8_t byte = static_cast<uint8_t>(entry);
+            if (entry & HuffmanDecodeTable::kLongCode) {
+                const HuffmanNode* node = table.nodes + (entry & ~HuffmanDecodeTable::kLongCode);
+                length = kTableBits;
+                while (node->left) {
+                    uint64_t at = bit_pos + length++;
+                    if (at >= total_bits) break;
+                    node = (bits[at >> 3] >> (7 - (at & 7))) & 1 ? node->right : node->left;
+                }
+                byte = node->byte;
+            }
+            if (bit_pos + length > total_bits) {
+                throw std::runtime_error("Corrupt huffman payload: stream ends inside a code");
+            }
+            if (pos==out.size()) {
+                throw std::runtime_error("Decoded chunk is larger than its output buffer");
+            }
+            out[pos++] = byte;
+            bit_pos += length;
+        }
+        return pos;
+    }
+
+    template <unsigned int MaxLength>
+    [[gnu::always_inline]] inline void decodeOne(uint64_t& window, uint64_t& bit_pos, const HuffmanDecodeTable& table,
+                                                 uint8_t& out) {
+        uint16_t entry = table.entries[window >> (64 - kTableBits)];
+        if constexpr (MaxLength > kTableBits) {
+            if (entry & HuffmanDecodeTable::kLongCode) {
+                const HuffmanNode* node = table.nodes + (entry & ~HuffmanDecodeTable::kLongCode);
+                window <<= kTableBits;
+                bit_pos += kTableBits;
+                while (node->left) {
+                    node = window >> 63 ? node->right : node->left;
+                    window <<= 1;
+                    bit_pos++;
+                }
+                out = node->byte;
+                return;
+            }
+        }
+        unsigned int length = entry >> 8;
+        out = static_cast<uint8_t>(entry);
+        window <<= length;
+        bit_pos += length;
+    }
+
+    template <unsigned int MaxLength, size_t... K>
+    [[gnu::always_inline]] inline void decodeGroup(uint64_t window, uint64_t& bit_pos, const HuffmanDecodeTable& table,
+                                                   uint8_t* out, std::index_sequence<K...>) {
+        (decodeOne<MaxLength>(window, bit_pos, table, out[K]), ...);
+    }
+
+    template <unsigned int MaxLength>
+    [[gnu::always_inline]] inline size_t decodeBody(std::span<const uint8_t> bits, uint64_t total_bits,
+                                                    const HuffmanDecodeTable& table, std::span<uint8_t> out) {
+        // a refill holds at least 57 bits, enough for a group of codes or one long code
+        constexpr unsigned int group = MaxLength <= kTableBits ? 56 / MaxLength : 1;
+        uint64_t bit_pos = 0;
+        size_t pos = 0;
+
+        // the window never reaches the last byte, so the padding needs no checks in here
+        while ((bit_pos >> 3) + 9 <= bits.size() && pos + group <= out.size()) {
+            uint64_t window = loadBigEndian(bits.data() + (bit_pos >> 3)) << (bit_pos & 7);
+            decodeGroup<MaxLength>(window, bit_pos, table, out.data() + pos, std::make_index_sequence<group>{});
+            pos += group;
+        }
+        return decodeTail(bits, total_bits, bit_pos, table, out, pos);
+    }
+
+    using EncodeKernel = size_t (*)(std::span<const uint8_t>, const std::array<HuffmanCode, 256>&,
+                                    std::span<uint8_t>, uint8_t&);
+    using DecodeKernel = size_t (*)(std::span<const uint8_t>, uint64_t, const HuffmanDecodeTable&, std::span<uint8_t>);
+
+    template <unsigned int MaxLength>
+    size_t encodeScalar(std::span<const uint8_t> chunk, const std::array<HuffmanCode, 256>& codes,
+                        std::span<uint8_t> out, uint8_t& padding) {
+        return encodeBody<MaxLength>(chunk, codes, out, padding);
+    }
+
+    template <unsigned int MaxLength>
+    size_t decodeScalar(std::span<const uint8_t> bits, uint64_t total_bits, const HuffmanDecodeTable& table,
+                        std::span<uint8_t> out) {
+        return decodeBody<MaxLength>(bits, total_bits, table, out);
+    }
+
+#ifdef MTC_HAVE_BMI2_KERNELS
+    template <unsigned int MaxLength>
+    __attribute__((target("bmi2"))) size_t encodeBmi2(std::span<const uint8_t> chunk,
+                                                      const std::array<HuffmanCode, 256>& codes,
+                                                      std::span<uint8_t> out, uint8_t& padding) {
+        return encodeBody<MaxLength>(chunk, codes, out, padding);
+    }
+
+    template <unsigned int MaxLength>
+    __attribute__((target("bmi2"))) size_t decodeBmi2(std::span<const uint8_t> bits, uint64_t total_bits,
+                                                      const HuffmanDecodeTable& table, std::span<uint8_t> out) {
+        return decodeBody<MaxLength>(bits, total_bits, table, out);
+    }
+#endif
+
+    // every variant of one instruction set, indexed like kEncodeLengths and kDecodeLengths
+    struct KernelSet {
+        std::array<EncodeKernel, kEncodeLengths.size()> encode;
+        std::array<DecodeKernel, kDecodeLengths.size()> decode;
+    };
+
+    template <size_t... E, size_t... D>
+    constexpr KernelSet scalarKernels(std::index_sequence<E...>, std::index_sequence<D...>) {
+        return {{&encodeScalar<kEncodeLengths[E]>...}, {&decodeScalar<kDecodeLengths[D]>...}};
+    }
+
+    constexpr KernelSet kScalar = scalarKernels(std::make_index_sequence<kEncodeLengths.size()>{},
+                                                std::make_index_sequence<kDecodeLengths.size()>{});
+
+#ifdef MTC_HAVE_BMI2_KERNELS
+    template <size_t... E, size_t... D>
+    constexpr KernelSet bmi2Kernels(std::index_sequence<E...>, std::index_sequence<D...>) {
+        return {{&encodeBmi2<kEncodeLengths[E]>...}, {&decodeBmi2<kDecodeLengths[D]>...}};
+    }
+
+    constexpr KernelSet kBmi2 = bmi2Kernels(std::make_index_sequence<kEncodeLengths.size()>{},
+                                            std::make_index_sequence<kDecodeLengths.size()>{});
+#endif
+
+    const KernelSet& kernelsFor(HuffmanKernels::Isa isa) {
+#ifdef MTC_HAVE_BMI2_KERNELS
+        if (isa==HuffmanKernels::Isa::Bmi2) {
+            return kBmi2;
+        }
+#endif
+        (void)isa;
+        return kScalar;
+    }
+
+    void fillDecodeTable(const HuffmanNode* node, uint32_t code, unsigned int depth, HuffmanDecodeTable& table) {
+        if (depth==kTableBits && node->left) {
+            table.entries[code] = HuffmanDecodeTable::kLongCode | static_cast<uint16_t>(node - table.nodes);
+        }
+        if (!node->left) {
+            table.min_length = table.min_length ? std::min(table.min_length, depth) : depth;
+            table.max_length = std::max(table.max_length, depth);
+            if (depth <= kTableBits) {
+                uint32_t first = code << (kTableBits - depth);
+                uint32_t count = uint32_t(1) << (kTableBits - depth);
+                for (uint32_t i=0; i<count; ++i) {
+                    table.entries[first + i] = static_cast<uint16_t>(depth << 8 | node->byte);
+                }
+            }
+            return;
+        }
+        // deserialized trees are full, every internal node has both children
+        uint32_t next = depth < kTableBits ? code << 1 : code;
+        fillDecodeTable(node->left, next, depth + 1, table);
+        fillDecodeTable(node->right, depth < kTableBits ? next | 1 : code, depth + 1, table);
+    }
+}
+
+bool HuffmanKernels::supported(Isa isa) {
+    if (isa==Isa::Scalar) {
+        return true;
+    }
+#ifdef MTC_HAVE_BMI2_KERNELS
+    return __builtin_cpu_supports("bmi2");
+#else
+    return false;
+#endif
+}
+
+HuffmanKernels::Isa HuffmanKernels::best() {
+    static const Isa isa = supported(Isa::Bmi2) ? Isa::Bmi2 : Isa::Scalar;
+    return isa;
+}
+
+void HuffmanKernels::buildDecodeTable(const HuffmanNode* root, const HuffmanNode* nodes, HuffmanDecodeTable& table) {
+    table.nodes = nodes;
+    table.min_length = 0;
+    table.max_length = 0;
+    if (!root) return;
+
+    // a lone leaf still spends one bit per byte
+    if (!root->left) {
+        table.entries.fill(static_cast<uint16_t>(1 << 8 | root->byte));
+        table.min_length = 1;
+        table.max_length = 1;
+        return;
+    }
+    fillDecodeTable(root, 0, 0, table);
+}
+
+size_t HuffmanKernels::encode(std::span<const uint8_t> chunk, const std::array<HuffmanCode, 256>& codes,
+                              unsigned int max_length, std::span<uint8_t> out, uint8_t& padding, Isa isa) {
+    if (max_length==0 || max_length >= kEncodeVariant.size()) {
+        return encodeTail(chunk, codes, out, 0, 0, 0, padding);
+    }
+    return kernelsFor(isa).encode[kEncodeVariant[max_length]](chunk, codes, out, padding);
+}
+
+size_t HuffmanKernels::decode(std::span<const uint8_t> bits, uint8_t padding, const HuffmanDecodeTable& table,
+                              std::span<uint8_t> out, Isa isa) {
+    if (bits.empty()) {
+        return 0;
+    }
+    if (padding > 7 || table.max_length==0) {
+        throw std::runtime_error("Corrupt huffman payload");
+    }
+    uint64_t total_bits = bits.size() * 8 - padding;
+    if (table.max_length >= kDecodeVariant.size()) {
+        return decodeTail(bits, total_bits, 0, table, out, 0);
+    }
+    return kernelsFor(isa).decode[kDecodeVariant[table.max_length]](bits, total_bits, table, out);
+}
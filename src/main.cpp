@@ -1,7 +1,135 @@
+#include "compression_daemon.h"
+#include "threaded_compressor.h"
 #include <iostream>
+#include <csignal>
+#include <string>
+#include <vector>
 
-int main() {
-    std::cout << "Project Initialized" << std::endl;
+namespace {
+    void usage() {
+        std::cerr << "usage: MultiThreadCompressor [QOS] compress|decompress INPUT OUTPUT\n"
+                  << "       MultiThreadCompressor --socket PATH compress|decompress INPUT OUTPUT\n"
+                  << "       MultiThreadCompressor --socket PATH daemon [--threads N] [--connections N] [--max-request BYTES]\n"
+                  << "           [--request-timeout SECONDS] [QOS]\n"
+                  << "       MultiThreadCompressor --socket PATH stop\n"
+                  << "With --socket, compress and decompress are sent to the daemon listening on PATH.\n"
+                  << "--connections is the number of requests the daemon serves at once.\n"
+                  << "--max-request caps a daemon request's input and decompressed size (default 1 GiB).\n"
+                  << "QOS: [--memory-budget BYTES] [--max-workers N] [--priority normal|low|idle] [--rate BYTES_PER_SECOND]\n"
+                  << "--memory-budget caps the chunk bytes in flight over all requests at once; requests\n"
+                  << "    of at most 64 KiB run inline and are not counted, nor are whole outputs.\n";
+    }
 
-    return 0;
-}
\ No newline at end of file
+    size_t count(const std::string& value) {
+        size_t pos = 0;
+        size_t n = std::stoul(value, &pos);
+        if (pos!=value.size()) {
+            throw std::invalid_argument("Not a number: " + value);
+        }
+        return n;
+    }
+
+    ThreadedCompressor::Priority priority(const std::string& value) {
+        if (value=="normal") return ThreadedCompressor::Priority::Normal;
+        if (value=="low") return ThreadedCompressor::Priority::Low;
+        if (value=="idle") return ThreadedCompressor::Priority::Idle;
+        throw std::invalid_argument("Unknown priority: " + value);
+    }
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> args(argv + 1, argv + argc);
+    std::string socket_path;
+    size_t threads = ThreadedCompressor::kAuto;
+    size_t connections = 4;
+    uint64_t max_request = CompressionDaemon::kDefaultMaxRequestSize;
+    std::chrono::milliseconds request_timeout = CompressionDaemon::kDefaultRequestTimeout;
+    size_t memory_budget = MemoryBudget::kUnlimited;
+    ThreadedCompressor::Qos qos;
+
+    try {
+        std::vector<std::string> positional;
+        for (size_t i=0; i<args.size(); ++i) {
+            bool has_value = i + 1 < args.size();
+            if (args[i]=="--socket" && has_value) {
+                socket_path = args[++i];
+            }
+            else if (args[i]=="--threads" && has_value) {
+                threads = count(args[++i]);
+            }
+            else if (args[i]=="--connections" && has_value) {
+                connections = count(args[++i]);
+            }
+            else if (args[i]=="--max-request" && has_value) {
+                max_request = count(args[++i]);
+            }
+            else if (args[i]=="--request-timeout" && has_value) {
+                request_timeout = std::chrono::seconds(count(args[++i]));
+            }
+            else if (args[i]=="--memory-budget" && has_value) {
+                memory_budget = count(args[++i]);
+            }
+            else if (args[i]=="--max-workers" && has_value) {
+                qos.max_workers = count(args[++i]);
+            }
+            else if (args[i]=="--priority" && has_value) {
+                qos.priority = priority(args[++i]);
+            }
+            else if (args[i]=="--rate" && has_value) {
+                qos.bytes_per_second = count(args[++i]);
+            }
+            else if (args[i].starts_with("--")) {
+                usage();
+                return 2;
+            }
+            else {
+                positional.push_back(args[i]);
+            }
+        }
+        if (positional.empty()) {
+            usage();
+            return 2;
+        }
+        const std::string& command = positional[0];
+
+        if (command=="daemon" && positional.size()==1 && !socket_path.empty()) {
+            // clients may hand over pipes they close early, that must not end the daemon
+            std::signal(SIGPIPE, SIG_IGN);
+            ThreadedCompressor compressor(std::make_unique<Huffman>(), ThreadedCompressor::kAuto, threads);
+            compressor.setLog(nullptr);
+            compressor.setMemoryBudget(memory_budget);
+            compressor.setQos(qos);
+            CompressionDaemon daemon(compressor, socket_path, connections);
+            daemon.setMaxRequestSize(max_request);
+            daemon.setRequestTimeout(request_timeout);
+            daemon.wait();
+            return 0;
+        }
+        if (command=="stop" && positional.size()==1 && !socket_path.empty()) {
+            DaemonClient(socket_path).stopDaemon();
+            return 0;
+        }
+        if ((command=="compress" || command=="decompress") && positional.size()==3) {
+            const std::string& input = positional[1];
+            const std::string& output = positional[2];
+            if (!socket_path.empty()) {
+                DaemonClient client(socket_path);
+                command=="compress" ? client.compressFile(input, output) : client.decompressFile(input, output);
+                return 0;
+            }
+            ThreadedCompressor compressor(std::make_unique<Huffman>(), ThreadedCompressor::kAuto, threads);
+            compressor.setLog(nullptr);
+            compressor.setMemoryBudget(memory_budget);
+            compressor.setQos(qos);
+            auto data = FileIO::readFile(input);
+            FileIO::writeFile(output, command=="compress" ? compressor.compress(data) : compressor.decompress(data));
+            return 0;
+        }
+        usage();
+        return 2;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "MultiThreadCompressor: " << e.what() << std::endl;
+        return 1;
+    }
+}
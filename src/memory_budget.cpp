@@ -0,0 +1,58 @@
+#include "memory_budget.h"
+#include <algorithm>
+#include <stdexcept>
+
+MemoryBudget::MemoryBudget(size_t limit) {
+    setLimit(limit);
+}
+
+void MemoryBudget::setLimit(size_t bytes) {
+    if (bytes==0) {
+        throw std::invalid_argument("Memory budget must be at least one byte");
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    state.limit = bytes;
+    state.peak = state.in_flight;
+    cv.notify_all();
+}
+
+bool MemoryBudget::fits(size_t bytes) const {
+    return state.in_flight==0 || (state.in_flight <= state.limit && bytes <= state.limit - state.in_flight);
+}
+
+void MemoryBudget::take(size_t bytes) {
+    state.in_flight += bytes;
+    state.peak = std::max(state.peak, state.in_flight);
+}
+
+bool MemoryBudget::tryAcquire(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!fits(bytes)) return false;
+    take(bytes);
+    return true;
+}
+
+void MemoryBudget::acquire(size_t bytes) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!fits(bytes)) {
+        state.waits++;
+        cv.wait(lock, [this, bytes]() { return fits(bytes); });
+    }
+    take(bytes);
+}
+
+void MemoryBudget::forceAcquire(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    take(bytes);
+}
+
+void MemoryBudget::release(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    state.in_flight -= std::min(bytes, state.in_flight);
+    cv.notify_all();
+}
+
+MemoryBudget::Usage MemoryBudget::usage() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return state;
+}
@@ -0,0 +1,178 @@
+#include "numa_topology.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#ifdef MTC_HAVE_LIBNUMA
+#include <numa.h>
+#include <numaif.h>
+#endif
+
+namespace {
+    // cpus the scheduler lets this process use
+    std::vector<int> allowedCpus() {
+        std::vector<int> cpus;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set)==0) {
+            for (int cpu=0; cpu<CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(cpu, &set)) {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+        if (cpus.empty()) {
+            for (unsigned int cpu=0; cpu<std::max(1u, std::thread::hardware_concurrency()); ++cpu) {
+                cpus.push_back(cpu);
+            }
+        }
+        return cpus;
+    }
+
+    // parses sysfs cpu lists such as "0-3,8-11"
+    std::vector<int> parseCpuList(const std::string& list) {
+        std::vector<int> cpus;
+        std::stringstream ranges(list);
+        std::string range;
+        while (std::getline(ranges, range, ',')) {
+            if (range.empty() || range=="\n") continue;
+            size_t dash = range.find('-');
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash==std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int cpu=first; cpu<=last; ++cpu) {
+                cpus.push_back(cpu);
+            }
+        }
+        return cpus;
+    }
+
+    std::vector<NumaTopology::Node> sysfsNodes() {
+        std::vector<NumaTopology::Node> nodes;
+        const std::filesystem::path root = "/sys/devices/system/node";
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(root, ec)) {
+            std::string name = entry.path().filename().string();
+            if (name.rfind("node", 0)!=0 || name.size()==4 || !std::isdigit(name[4])) continue;
+
+            std::ifstream file(entry.path() / "cpulist");
+            std::string list;
+            if (!std::getline(file, list)) continue;
+            nodes.push_back({std::stoi(name.substr(4)), parseCpuList(list)});
+        }
+        return nodes;
+    }
+
+#ifdef MTC_HAVE_LIBNUMA
+    std::vector<NumaTopology::Node> libnumaNodes() {
+        std::vector<NumaTopology::Node> nodes;
+        if (numa_available() < 0) {
+            return nodes;
+        }
+        struct bitmask* mask = numa_allocate_cpumask();
+        for (int node=0; node<=numa_max_node(); ++node) {
+            if (numa_node_to_cpus(node, mask)!=0) continue;
+            NumaTopology::Node entry{node, {}};
+            for (unsigned int cpu=0; cpu<mask->size; ++cpu) {
+                if (numa_bitmask_isbitset(mask, cpu)) {
+                    entry.cpus.push_back(cpu);
+                }
+            }
+            nodes.push_back(std::move(entry));
+        }
+        numa_free_cpumask(mask);
+        return nodes;
+    }
+#endif
+}
+
+NumaTopology::NumaTopology(std::vector<Node> nodes)
+    : nodes(std::move(nodes)) {
+    if (this->nodes.empty()) {
+        throw std::invalid_argument("NUMA topology needs at least one node");
+    }
+}
+
+NumaTopology NumaTopology::detect() {
+    std::vector<Node> found;
+#ifdef MTC_HAVE_LIBNUMA
+    found = libnumaNodes();
+#endif
+    if (found.empty()) {
+        found = sysfsNodes();
+    }
+
+    // keep only cpus we may run on and drop memory-only nodes
+    std::vector<int> allowed = allowedCpus();
+    std::vector<Node> nodes;
+    for (auto& node : found) {
+        std::erase_if(node.cpus, [&](int cpu) {
+            return std::find(allowed.begin(), allowed.end(), cpu)==allowed.end();
+        });
+        if (!node.cpus.empty()) {
+            nodes.push_back(std::move(node));
+        }
+    }
+    if (nodes.empty()) {
+        nodes.push_back({0, allowed});
+    }
+    std::sort(nodes.begin(), nodes.end(), [](const Node& a, const Node& b) { return a.id < b.id; });
+    return NumaTopology(std::move(nodes));
+}
+
+NumaTopology::Placement NumaTopology::placeWorker(size_t worker) const {
+    const Node& node = nodes[worker % nodes.size()];
+    size_t slot = worker / nodes.size();
+    return {node.id, node.cpus[slot % node.cpus.size()]};
+}
+
+bool NumaTopology::pinCurrentThread(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set)==0;
+}
+
+void NumaTopology::bindMemory(void* data, size_t size, int node) {
+#ifdef MTC_HAVE_LIBNUMA
+    if (node < 0 || size==0 || numa_available() < 0) return;
+
+    // mbind works on whole pages; the partial ones at either end may hold other heap
+    // objects, so only the pages entirely inside the range are bound
+    const uintptr_t page = sysconf(_SC_PAGESIZE);
+    uintptr_t begin = (reinterpret_cast<uintptr_t>(data) + page - 1) & ~(page - 1);
+    uintptr_t end = (reinterpret_cast<uintptr_t>(data) + size) & ~(page - 1);
+    if (begin >= end) return;
+
+    // malloc may hand back pages it already faulted in, those are migrated
+    struct bitmask* nodes = numa_allocate_nodemask();
+    numa_bitmask_setbit(nodes, node);
+    mbind(reinterpret_cast<void*>(begin), end - begin, MPOL_BIND, nodes->maskp, nodes->size + 1, MPOL_MF_MOVE);
+    numa_free_nodemask(nodes);
+#else
+    (void)data;
+    (void)size;
+    (void)node;
+#endif
+}
+
+bool NumaTopology::hasLibnuma() {
+#ifdef MTC_HAVE_LIBNUMA
+    return numa_available() >= 0;
+#else
+    return false;
+#endif
+}
+
+// getters
+const std::vector<NumaTopology::Node>& NumaTopology::getNodes() const {
+    return nodes;
+}
@@ -0,0 +1,54 @@
+#include "rate_limiter.h"
+#include <algorithm>
+
+RateLimiter::RateLimiter(uint64_t bytes_per_second)
+: rate(bytes_per_second), last(Clock::now()) {
+
+}
+
+void RateLimiter::refill(Clock::time_point now) {
+    if (rate!=kUnlimited) {
+        double elapsed = std::chrono::duration<double>(now - last).count();
+        tokens = std::min(tokens + elapsed * rate, rate / 10.0);
+    }
+    last = now;
+}
+
+void RateLimiter::setRate(uint64_t bytes_per_second) {
+    std::lock_guard<std::mutex> lock(mutex);
+    refill(Clock::now());
+    rate = bytes_per_second;
+    if (rate==kUnlimited) {
+        tokens = 0;
+    }
+    else {
+        tokens = std::min(tokens, rate / 10.0);
+    }
+    cv.notify_all();
+}
+
+uint64_t RateLimiter::getRate() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return rate;
+}
+
+void RateLimiter::acquire(size_t bytes) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (rate==kUnlimited) return;
+
+    auto start = Clock::now();
+    refill(start);
+    while (rate!=kUnlimited && tokens < 0) {
+        cv.wait_for(lock, std::chrono::duration<double>(-tokens / rate));
+        refill(Clock::now());
+    }
+    if (rate!=kUnlimited) {
+        tokens -= static_cast<double>(bytes);
+    }
+    waited += Clock::now() - start;
+}
+
+std::chrono::nanoseconds RateLimiter::getWaited() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return waited;
+}
@@ -1,45 +1,1089 @@
 #include "threaded_compressor.h"
 #include <fstream>
 #include <stdexcept>
-#include <future>
+#include <system_error>
+#include <filesystem>
+#include <numeric>
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
 
-ThreadedCompressor::ThreadedCompressor(std::unique_ptr<Compressor> comp, size_t chunkSize, size_t threadCount)
-    : compressor(std::move(comp)), chunk_size(chunkSize), thread_count(threadCount) {}
+namespace {
+    // Moves a worker to a priority in the order an unprivileged process is allowed to go:
+    // nice drops to 19 before SCHED_IDLE and stays there, raising it back and leaving
+    // SCHED_IDLE need CAP_SYS_NICE or RLIMIT_NICE. A refused step comes before any change.
+    void setThreadPriority(pid_t tid, ThreadedCompressor::Priority priority) {
+        using Priority = ThreadedCompressor::Priority;
+        int policy = priority==Priority::Idle ? SCHED_IDLE : SCHED_OTHER;
+        int nice = priority==Priority::Normal ? 0 : 19;
 
-std::vector<Compressor::EncodedData> ThreadedCompressor::compressFile(const std::string& path) {
-    FileIO io;
-    auto data = io.readFile(path);
-    Chunker chunker(chunk_size);
-    auto chunks = chunker.split(data);
+        errno = 0;
+        int current_nice = getpriority(PRIO_PROCESS, tid);
+        int current_policy = sched_getscheduler(tid);
+        if ((current_nice==-1 && errno!=0) || current_policy < 0) {
+            throw std::system_error(errno, std::generic_category(), "Failed to read worker priority");
+        }
+        if (nice > current_nice && setpriority(PRIO_PROCESS, tid, nice)!=0) {
+            throw std::system_error(errno, std::generic_category(), "Failed to set worker nice value");
+        }
+        sched_param param{};
+        if (policy!=current_policy && sched_setscheduler(tid, policy, &param)!=0) {
+            throw std::system_error(errno, std::generic_category(), "Failed to set worker scheduling policy");
+        }
+        if (nice < current_nice && setpriority(PRIO_PROCESS, tid, nice)!=0) {
+            throw std::system_error(errno, std::generic_category(), "Failed to set worker nice value");
+        }
+    }
 
-    if (chunks.empty()) return {}; // empty file
+    // slice of out a chunk decodes into; sizes come from an untrusted index
+    std::span<uint8_t> chunkTarget(std::span<uint8_t> out, size_t pos, uint64_t size) {
+        if (pos > out.size() || size > out.size() - pos) {
+            throw std::runtime_error("Corrupt archive: chunk larger than the output");
+        }
+        return out.subspan(pos, size);
+    }
+}
+
+template <typename ChunkBits>
+std::vector<size_t> ThreadedCompressor::runStarts(size_t count, ChunkBits&& bits) const {
+    std::vector<size_t> starts;
+    for (size_t i=0; i<count; ++i) {
+        if (starts.empty() || compressor->standsAlone(bits(i))) {
+            starts.push_back(i);
+        }
+    }
+    return starts;
+}
 
-    // Launch parallel compression tasks
-    std::vector<std::future<Compressor::EncodedData>> futures;
-    futures.reserve(chunks.size());
+ThreadedCompressor::ThreadedCompressor(std::unique_ptr<Compressor> comp, size_t chunkSize, size_t threadCount,
+                                       Placement placement)
+    : thread_count(threadCount), chunk_size(chunkSize), auto_tune(chunkSize==kAuto), placement(placement),
+      compressor(std::move(comp)) {
+    if (!compressor) {
+        throw std::invalid_argument("ThreadedCompressor needs a compressor");
+    }
+    if (thread_count==kAuto) {
+        thread_count = AutoTuner::MachineInfo::detect().cores;
+    }
 
-    for (auto& c : chunks) {
-        futures.emplace_back(std::async(std::launch::async, [this, &c]() {
-            return this->compressor->compress(c.data);
-        }));
+    workers_.reserve(thread_count);
+    if (placement==Placement::NumaPinned) {
+        auto topology = NumaTopology::detect();
+        const auto& nodes = topology.getNodes();
+        task_queues_.resize(nodes.size());
+        for (size_t i=0; i<thread_count; ++i) {
+            auto where = topology.placeWorker(i);
+            auto worker = std::make_unique<Worker>(where.node, where.cpu);
+            worker->queue = i % nodes.size();
+            workers_.push_back(std::move(worker));
+        }
+    }
+    else {
+        task_queues_.resize(1);
+        for (size_t i=0; i<thread_count; ++i) {
+            workers_.push_back(std::make_unique<Worker>());
+            workers_.back()->queue = 0;
+        }
     }
+    for (size_t i=0; i<workers_.size(); ++i) {
+        workers_[i]->compressor = compressor->clone();
+        workers_[i]->index = i;
+    }
+    active_workers_ = workers_.size();
 
-    // Collect results
-    std::vector<Compressor::EncodedData> output;
-    for (auto& f : futures) {
-        Compressor::EncodedData encoded = f.get();
-        output.insert(output.end(), encoded);
+    // start threads only once every worker exists, and wait for their thread ids
+    std::latch started(static_cast<std::ptrdiff_t>(workers_.size()));
+    for (auto& worker : workers_) {
+        worker->thread = std::thread(&ThreadedCompressor::workerThread, this, std::ref(*worker), std::ref(started));
+    }
+    started.wait();
+}
+
+ThreadedCompressor::~ThreadedCompressor() {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        shutdown_flag_ = true;
+    }
+    // what is left in the queues runs unthrottled
+    throttle_.setRate(RateLimiter::kUnlimited);
+    queue_cv_.notify_all();
+    for (auto& worker : workers_) {
+        worker->thread.join();
+    }
+}
+
+void ThreadedCompressor::workerThread(Worker& worker, std::latch& started) {
+    // pin before the first allocation so first-touch pages land on the worker's node
+    if (worker.cpu >= 0) {
+        NumaTopology::pinCurrentThread(worker.cpu);
+    }
+    worker.tid = gettid();
+    started.count_down();
+
+    auto hasTask = [this]() {
+        for (const auto& queue : task_queues_) {
+            if (!queue.empty()) return true;
+        }
+        return false;
+    };
+
+    while (true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            // workers over the QoS limit sit out until it rises again
+            queue_cv_.wait(lock, [&]() {
+                return shutdown_flag_ || (worker.index < active_workers_ && hasTask());
+            });
+            if (!hasTask()) {
+                return;
+            }
+            // own node first, then steal so no worker idles while another node has a backlog
+            for (size_t i=0; i<task_queues_.size(); ++i) {
+                auto& queue = task_queues_[(worker.queue + i) % task_queues_.size()];
+                if (!queue.empty()) {
+                    task = queue.front();
+                    queue.pop();
+                    break;
+                }
+            }
+        }
+        throttle_.acquire(taskBytes(task));
+        runTask(worker, task);
+    }
+}
+
+size_t ThreadedCompressor::taskBytes(const Task& task) const {
+    size_t bytes = 0;
+    if (task.job) {
+        for (size_t i=task.chunk_index; i<task.chunk_index + task.chunk_count; ++i) {
+            bytes += task.job->chunks[i].size();
+        }
+    }
+    else if (!task.batch_inputs.empty()) {
+        for (const auto& input : task.batch_inputs) {
+            bytes += input.size();
+        }
     }
+    else if (task.encoded) {
+        for (size_t k=0; k<task.chunk_count; ++k) {
+            bytes += task.encoded[k].bits.size();
+        }
+    }
+    else if (task.is_decompression) {
+        for (const auto& entry : task.entries) {
+            bytes += entry.compressed_size;
+        }
+    }
+    else {
+        bytes = task.data.size();
+    }
+    return bytes;
+}
+
+void ThreadedCompressor::runTask(Worker& worker, Task& task) {
+    if (task.job) {
+        runJobChunk(worker, task);
+        return;
+    }
+    task.result->chunk_index = task.chunk_index;
+
+    try {
+        if (!task.batch_inputs.empty()) {
+            for (size_t i=0; i<task.batch_inputs.size(); ++i) {
+                task.batch_outputs[i] = task.is_decompression
+                    ? decompressArchive(*worker.compressor, task.batch_inputs[i], readEntries(task.batch_inputs[i]))
+                    : compressArchive(*worker.compressor, task.batch_inputs[i]);
+            }
+        }
+        else if (task.is_decompression && task.encoded) {
+            worker.compressor->resetStream();
+            for (size_t k=0; k<task.chunk_count; ++k) {
+                task.result[k].chunk_index = task.chunk_index + k;
+                task.result[k].decoded = worker.compressor->decompress(task.encoded[k]);
+                chunks_decompressed_++;
+            }
+        }
+        else if (task.is_decompression) {
+            // a run of archive chunks, each decoded into its slice of the output
+            worker.compressor->resetStream();
+            size_t pos = 0;
+            for (const auto& entry : task.entries) {
+                auto target = chunkTarget(task.output, pos, entry.original_size);
+                auto bits = task.data.subspan(entry.offset, entry.compressed_size);
+                if (worker.compressor->decompress(bits, entry.padding, target)!=target.size()) {
+                    throw std::runtime_error("Corrupt archive: chunk decoded to the wrong size");
+                }
+                pos += entry.original_size;
+                chunks_decompressed_++;
+            }
+        }
+        else {
+            worker.compressor->resetStream();
+            for (size_t k=0; k<task.chunk_count; ++k) {
+                auto chunk = task.chunk_count==1 ? task.data
+                    : task.data.subspan(k * chunk_size, std::min(chunk_size, task.data.size() - k * chunk_size));
+                task.result[k].chunk_index = task.chunk_index + k;
+                compressChunk(worker, chunk, task.recycle, task.result[k]);
+            }
+        }
+    }
+    catch (...) {
+        std::lock_guard<std::mutex> lock(task.batch->mutex);
+        if (!task.batch->error) {
+            task.batch->error = std::current_exception();
+        }
+    }
+
+    // notify under the lock, the submitter may destroy the batch as soon as pending hits zero
+    std::lock_guard<std::mutex> lock(task.batch->mutex);
+    for (size_t k=0; k<task.chunk_count; ++k) {
+        task.result[k].done = true;
+    }
+    task.batch->pending--;
+    task.batch->cv.notify_all();
+}
+
+void ThreadedCompressor::compressChunk(Worker& worker, std::span<const uint8_t> chunk, bool recycle, Result& result) {
+    auto start = std::chrono::steady_clock::now();
+
+    // one sequential copy into a node-local buffer beats two passes over remote memory
+    std::vector<uint8_t> local;
+    std::span<const uint8_t> input = chunk;
+    if (worker.node >= 0) {
+        local = worker.pool.acquire(chunk.size());
+        std::copy(chunk.begin(), chunk.end(), local.begin());
+        input = local;
+    }
+
+    auto buffer = worker.pool.acquire(worker.compressor->compressBound(input.size()));
+    buffer.resize(worker.compressor->compress(input, buffer, result.encoded.padding));
+    if (worker.node >= 0) {
+        worker.pool.release(std::move(local));
+    }
+    if (recycle) {
+        result.encoded.bits = std::move(buffer);
+        result.pool = &worker.pool;
+    }
+    else {
+        result.encoded.bits.assign(buffer.begin(), buffer.end());
+        worker.pool.release(std::move(buffer));
+    }
+    result.input_size = chunk.size();
+    result.elapsed = std::chrono::steady_clock::now() - start;
+    chunks_compressed_++;
+}
+
+void ThreadedCompressor::submit(const Task& task) {
+    if (task.batch) {
+        std::lock_guard<std::mutex> lock(task.batch->mutex);
+        task.batch->pending++;
+    }
+    bool throttled = false;
+    {
+        // consecutive chunks go to consecutive nodes
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        task_queues_[next_queue_++ % task_queues_.size()].push(task);
+        throttled = active_workers_ < workers_.size();
+    }
+    // one wakeup could land on a worker that sits out and be lost
+    if (throttled) {
+        queue_cv_.notify_all();
+    }
+    else {
+        queue_cv_.notify_one();
+    }
+}
 
+void ThreadedCompressor::waitForBatch(Batch& batch) {
+    std::unique_lock<std::mutex> lock(batch.mutex);
+    batch.cv.wait(lock, [&batch]() { return batch.pending==0; });
+    if (batch.error) {
+        std::rethrow_exception(batch.error);
+    }
+}
+
+void ThreadedCompressor::runJobChunk(Worker& worker, Task& task) {
+    auto& job = *task.job;
+    std::exception_ptr failure;
+
+    // chunks queued before a cancel are dropped here
+    if (!job.cancelled) {
+        try {
+            if (job.decompress) {
+                // a run decodes in order, later chunks may reuse tables of earlier ones
+                worker.compressor->resetStream();
+                for (size_t i=task.chunk_index; i<task.chunk_index + task.chunk_count && !job.cancelled; ++i) {
+                    size_t written = worker.compressor->decompress(job.chunks[i], job.entries[i].padding,
+                                                                   job.targets[i]);
+                    if (written!=job.targets[i].size()) {
+                        throw std::runtime_error("Corrupt archive: chunk decoded to the wrong size");
+                    }
+                    chunks_decompressed_++;
+                    job.chunkFinished(written);
+                }
+            }
+            else {
+                auto& encoded = job.encoded[task.chunk_index];
+                worker.compressor->resetStream();
+                auto buffer = worker.pool.acquire(worker.compressor->compressBound(task.data.size()));
+                buffer.resize(worker.compressor->compress(task.data, buffer, encoded.padding));
+                encoded.bits.assign(buffer.begin(), buffer.end());
+                worker.pool.release(std::move(buffer));
+                chunks_compressed_++;
+                job.chunkFinished(task.data.size());
+            }
+        }
+        catch (...) {
+            failure = std::current_exception();
+        }
+    }
+    budget_.release(task.charged);
+    scheduleJob(task.job, true, failure);
+}
+
+void ThreadedCompressor::scheduleJob(const std::shared_ptr<AsyncJob::State>& job, bool chunk_finished,
+                                     std::exception_ptr failure) {
+    std::vector<Task> ready;
+    bool finished = false;
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        if (chunk_finished) {
+            job->in_flight--;
+        }
+        if (failure && !job->error) {
+            job->error = failure;
+        }
+        bool stopped = job->cancelled || job->error;
+        while (!stopped && job->next_run < job->runs.size() && job->in_flight < workers_.size()) {
+            size_t r = job->next_run;
+            size_t i = job->runs[r];
+            size_t count = (r + 1 < job->runs.size() ? job->runs[r + 1] : job->chunks.size()) - i;
+            size_t cost = 0;
+            for (size_t k=i; k<i + count; ++k) {
+                cost += job->decompress ? job->chunks[k].size() + job->targets[k].size() : chunkCost(job->chunks[k].size());
+            }
+            // this may run on a worker, which must not block: a job short of budget waits for
+            // its own chunks to finish, and a job with none running takes one chunk anyway
+            if (!budget_.tryAcquire(cost)) {
+                if (job->in_flight > 0) break;
+                budget_.forceAcquire(cost);
+            }
+            job->next_run++;
+
+            Task task{i, job->chunks[i]};
+            task.chunk_count = count;
+            task.charged = cost;
+            task.is_decompression = job->decompress;
+            task.job = job;
+            ready.push_back(std::move(task));
+            job->in_flight++;
+        }
+        finished = job->in_flight==0 && (stopped || job->next_run==job->runs.size());
+    }
+    for (const auto& task : ready) {
+        submit(task);
+    }
+    if (!finished) return;
+
+    if (job->error) {
+        job->complete({}, job->error);
+    }
+    else if (job->cancelled) {
+        job->complete({}, std::make_exception_ptr(std::system_error(
+            std::make_error_code(std::errc::operation_canceled), "Compression job cancelled")));
+    }
+    else if (job->decompress) {
+        job->complete(std::move(job->decoded), nullptr);
+    }
+    else {
+        std::vector<uint8_t> archive;
+        ArchiveWriter writer(archive);
+        for (size_t i=0; i<job->chunks.size(); ++i) {
+            writer.add(job->encoded[i].bits, job->encoded[i].padding, job->chunks[i].size());
+        }
+        writer.finish();
+        job->encoded.clear();
+        job->complete(std::move(archive), nullptr);
+    }
+}
+
+AsyncJob ThreadedCompressor::compressAsync(std::vector<uint8_t> input, AsyncJob::Options options) {
+    auto job = std::make_shared<AsyncJob::State>();
+    job->input = std::move(input);
+    job->options = std::move(options);
+    job->bytes_total = job->input.size();
+
+    size_t step = chunk_size;
+    if (auto_tune) {
+        step = AutoTuner(job->input.size(), workers_.size(), AutoTuner::MachineInfo::detect()).getChunkSize();
+    }
+    job->chunks = Chunker(step).view(job->input);
+    job->encoded.resize(job->chunks.size());
+    job->runs.resize(job->chunks.size());
+    std::iota(job->runs.begin(), job->runs.end(), 0);
+
+    scheduleJob(job, false, nullptr);
+    return AsyncJob(job);
+}
+
+AsyncJob ThreadedCompressor::decompressAsync(std::vector<uint8_t> archive, AsyncJob::Options options) {
+    auto job = std::make_shared<AsyncJob::State>();
+    job->decompress = true;
+    job->input = std::move(archive);
+    job->options = std::move(options);
+
+    // a bad archive fails the job like any other error instead of throwing at the caller
+    std::exception_ptr failure;
+    try {
+        job->entries = readEntries(job->input);
+        job->bytes_total = Archive::originalSize(job->entries);
+        job->decoded.resize(job->bytes_total);
+
+        size_t pos = 0;
+        for (const auto& entry : job->entries) {
+            job->chunks.push_back(std::span<const uint8_t>(job->input).subspan(entry.offset, entry.compressed_size));
+            job->targets.push_back(chunkTarget(job->decoded, pos, entry.original_size));
+            pos += entry.original_size;
+        }
+        job->runs = runStarts(job->chunks.size(), [&job](size_t i) { return job->chunks[i]; });
+    }
+    catch (...) {
+        failure = std::current_exception();
+    }
+
+    scheduleJob(job, false, failure);
+    return AsyncJob(job);
+}
+
+std::vector<Compressor::EncodedData> ThreadedCompressor::compressFile(const std::string& path) {
+    auto data = FileIO::readFile(path);
+    std::vector<Compressor::EncodedData> output;
+    compressData(data, [&output](Compressor::EncodedData&& encoded, size_t) {
+        output.push_back(std::move(encoded));
+    });
     return output;
 }
 
+void ThreadedCompressor::compressData(std::span<const uint8_t> data,
+                                      const std::function<void(Compressor::EncodedData&&, size_t)>& emit) {
+    if (auto_tune) {
+        AutoTuner tuner(data.size(), workers_.size(), AutoTuner::MachineInfo::detect());
+        if (log_) *log_ << tuner.describe() << " input=" << data.size() << std::endl;
+
+        size_t offset = 0;
+        auto source = [&](size_t max_size, std::vector<uint8_t>&) {
+            auto chunk = data.subspan(offset, std::min(max_size, data.size() - offset));
+            offset += chunk.size();
+            return chunk;
+        };
+        runPipeline(source, &tuner, [&](const Compressor::EncodedData& encoded, size_t original_size) {
+            emit(Compressor::EncodedData(encoded), original_size);
+        });
+
+        if (log_ && tuner.getAdjustments() > 0) *log_ << tuner.describe() << std::endl;
+        return;
+    }
+
+    Chunker chunker(chunk_size);
+    auto chunks = chunker.view(data);
+
+    if (chunks.empty()) return; // empty input
+
+    // Consecutive chunks share a task so a compressor carrying its table from chunk to chunk
+    // can reuse it, a few tasks per worker keep the load balanced. Tasks are submitted as
+    // far as the memory budget allows and delivered in order, each handing its bytes back.
+    // A task never costs more than the whole budget, so only a chunk that alone exceeds it
+    // goes over.
+    std::vector<Result> results(chunks.size());
+    Batch batch;
+    const size_t run = std::max<size_t>(1, std::min(chunks.size() / (workers_.size() * 4),
+                                                    budget_.usage().limit / chunkCost(chunk_size)));
+    const size_t runs = (chunks.size() + run - 1) / run;
+    auto runCost = [&](size_t r) {
+        size_t cost = 0;
+        for (size_t i=r * run; i<std::min(chunks.size(), (r + 1) * run); ++i) {
+            cost += chunkCost(chunks[i].size());
+        }
+        return cost;
+    };
+
+    size_t submitted = 0;
+    size_t delivered = 0;
+    size_t charged = 0;
+    try {
+        while (delivered < runs) {
+            // block on the budget only with nothing of ours left to deliver
+            while (submitted < runs) {
+                size_t cost = runCost(submitted);
+                if (!budget_.tryAcquire(cost)) {
+                    if (delivered < submitted) break;
+                    budget_.acquire(cost);
+                }
+                charged += cost;
+
+                size_t first = submitted * run;
+                size_t offset = first * chunk_size;
+                Task task{first, data.subspan(offset, std::min(run * chunk_size, data.size() - offset))};
+                task.chunk_count = std::min(run, chunks.size() - first);
+                task.result = &results[first];
+                task.batch = &batch;
+                submit(task);
+                submitted++;
+            }
+
+            size_t first = delivered * run;
+            {
+                std::unique_lock<std::mutex> lock(batch.mutex);
+                batch.cv.wait(lock, [&]() { return results[first].done || batch.error; });
+                if (batch.error) {
+                    std::rethrow_exception(batch.error);
+                }
+            }
+            for (size_t i=first; i<std::min(chunks.size(), first + run); ++i) {
+                emit(std::move(results[i].encoded), chunks[i].size());
+                results[i].encoded.bits = {};
+            }
+            size_t cost = runCost(delivered);
+            budget_.release(cost);
+            charged -= cost;
+            delivered++;
+        }
+    }
+    catch (...) {
+        // tasks still point at this frame's results, let them finish first
+        std::unique_lock<std::mutex> lock(batch.mutex);
+        batch.cv.wait(lock, [&batch]() { return batch.pending==0; });
+        budget_.release(charged);
+        throw;
+    }
+    last_chunk_size_ = chunk_size;
+    last_thread_count_ = std::min(workers_.size(), chunks.size());
+}
+
 std::vector<uint8_t> ThreadedCompressor::decompressFile(const std::vector<Compressor::EncodedData>& compressed) {
-    // Decompression is single-threaded unless you implement chunk metadata.
+    // runs of chunks that depend on the chunk before them decode in order on one worker
+    auto starts = runStarts(compressed.size(), [&compressed](size_t i) {
+        return std::span<const uint8_t>(compressed[i].bits);
+    });
+    std::vector<Result> results(compressed.size());
+    Batch batch;
+    for (size_t r=0; r<starts.size(); ++r) {
+        size_t first = starts[r];
+        Task task{first, {}};
+        task.encoded = &compressed[first];
+        task.chunk_count = (r + 1 < starts.size() ? starts[r + 1] : compressed.size()) - first;
+        task.is_decompression = true;
+        task.result = &results[first];
+        task.batch = &batch;
+        submit(task);
+    }
+    waitForBatch(batch);
+
+    size_t total = 0;
+    for (const auto& r : results) {
+        total += r.decoded.size();
+    }
     std::vector<uint8_t> output;
-    for (auto d: compressed) {
-        auto decompressed = compressor.get()->decompress(d);
-        output.insert(output.end(), decompressed.begin(), decompressed.end());
+    output.reserve(total);
+    for (const auto& r : results) {
+        output.insert(output.end(), r.decoded.begin(), r.decoded.end());
     }
     return output;
 }
+
+void ThreadedCompressor::compressStream(std::istream& input,
+                                        const std::function<void(const Compressor::EncodedData&)>& sink) {
+    auto source = [&](size_t max_size, std::vector<uint8_t>& storage) {
+        storage = input_pool_.acquire(max_size);
+        input.read(reinterpret_cast<char*>(storage.data()), max_size);
+        storage.resize(input.gcount());
+        return std::span<const uint8_t>(storage);
+    };
+
+    if (auto_tune) {
+        AutoTuner tuner(0, workers_.size(), AutoTuner::MachineInfo::detect());
+        if (log_) *log_ << tuner.describe() << " input=stream" << std::endl;
+        runPipeline(source, &tuner, [&sink](const Compressor::EncodedData& encoded, size_t) { sink(encoded); });
+        if (log_ && tuner.getAdjustments() > 0) *log_ << tuner.describe() << std::endl;
+        return;
+    }
+    runPipeline(source, nullptr, [&sink](const Compressor::EncodedData& encoded, size_t) { sink(encoded); });
+}
+
+size_t ThreadedCompressor::queueDepth() {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    size_t depth = 0;
+    for (const auto& queue : task_queues_) {
+        depth += queue.size();
+    }
+    return depth;
+}
+
+void ThreadedCompressor::runPipeline(const ChunkSource& source, AutoTuner* tuner,
+                                     const std::function<void(const Compressor::EncodedData&, size_t)>& deliver) {
+    // enough chunks in flight to keep every worker busy while deliver drains the oldest
+    const size_t window = tuner ? tuner->getWindow() : 2 * workers_.size();
+    std::vector<Result> slots(window);
+    std::vector<std::vector<uint8_t>> inputs(window);
+    std::vector<size_t> costs(window);
+    Batch batch;
+
+    size_t submitted = 0;
+    size_t delivered = 0;
+    size_t charged = 0;
+    bool eof = false;
+
+    auto recycleInput = [this](std::vector<uint8_t>& storage) {
+        input_pool_.release(std::move(storage));
+        storage = {};
+    };
+
+    try {
+        while (true) {
+            while (!eof && submitted - delivered < window) {
+                size_t slot = submitted % window;
+                size_t max_size = tuner ? tuner->getChunkSize() : chunk_size;
+
+                // the chunk is paid for before it is read, so a full budget holds the reader
+                // back; it only blocks once everything of ours has been delivered
+                size_t cost = chunkCost(max_size);
+                if (!budget_.tryAcquire(cost)) {
+                    if (delivered < submitted) break;
+                    budget_.acquire(cost);
+                }
+                costs[slot] = cost;
+                charged += cost;
+
+                auto chunk = source(max_size, inputs[slot]);
+                if (chunk.size() < max_size) {
+                    eof = true;
+                }
+                if (chunk.empty()) {
+                    recycleInput(inputs[slot]);
+                    budget_.release(cost);
+                    charged -= cost;
+                    break;
+                }
+
+                slots[slot].done = false;
+                Task task{submitted, chunk};
+                task.recycle = true;
+                task.result = &slots[slot];
+                task.batch = &batch;
+                submit(task);
+                submitted++;
+            }
+            if (delivered==submitted) {
+                break;
+            }
+
+            size_t slot = delivered % window;
+            Result& next = slots[slot];
+            {
+                std::unique_lock<std::mutex> lock(batch.mutex);
+                batch.cv.wait(lock, [&]() { return next.done || batch.error; });
+                if (batch.error) {
+                    std::rethrow_exception(batch.error);
+                }
+            }
+            if (tuner) {
+                tuner->record(next.input_size, next.elapsed, queueDepth());
+            }
+
+            deliver(next.encoded, next.input_size);
+
+            // hand both buffers back before the slot is reused
+            next.pool->release(std::move(next.encoded.bits));
+            next.encoded.bits = {};
+            recycleInput(inputs[slot]);
+            budget_.release(costs[slot]);
+            charged -= costs[slot];
+            delivered++;
+        }
+    }
+    catch (...) {
+        // tasks still point at this frame's buffers, let them finish first
+        std::unique_lock<std::mutex> lock(batch.mutex);
+        batch.cv.wait(lock, [&batch]() { return batch.pending==0; });
+        budget_.release(charged);
+        throw;
+    }
+
+    last_chunk_size_ = tuner ? tuner->getChunkSize() : chunk_size;
+    last_thread_count_ = tuner ? tuner->getThreadCount() : workers_.size();
+}
+
+bool ThreadedCompressor::runsInline(size_t bytes) const {
+    return bytes <= kInlineThreshold && !throttled_;
+}
+
+std::unique_ptr<Compressor> ThreadedCompressor::borrowCompressor() {
+    {
+        std::lock_guard<std::mutex> lock(inline_mutex_);
+        if (!inline_compressors_.empty()) {
+            auto comp = std::move(inline_compressors_.back());
+            inline_compressors_.pop_back();
+            return comp;
+        }
+    }
+    return compressor->clone();
+}
+
+void ThreadedCompressor::returnCompressor(std::unique_ptr<Compressor> comp) {
+    std::lock_guard<std::mutex> lock(inline_mutex_);
+    inline_compressors_.push_back(std::move(comp));
+}
+
+std::vector<uint8_t> ThreadedCompressor::compressArchive(Compressor& comp, std::span<const uint8_t> input) const {
+    const size_t step = auto_tune ? AutoTuner::kMinChunkSize : chunk_size;
+
+    // one allocation up front: every chunk at its bound plus the largest possible index
+    std::vector<uint8_t> out;
+    size_t chunks = (input.size() + step - 1) / step;
+    out.reserve(input.size() + chunks * (comp.compressBound(0) + Archive::kMaxEntrySize)
+                + Archive::kMaxEntrySize + Archive::kFooterSize);
+
+    ArchiveWriter writer(out);
+    compressChunks(comp, input, writer);
+    writer.finish();
+    return out;
+}
+
+void ThreadedCompressor::compressChunks(Compressor& comp, std::span<const uint8_t> input, ArchiveWriter& writer) const {
+    const size_t step = auto_tune ? AutoTuner::kMinChunkSize : chunk_size;
+    comp.resetStream();
+    for (size_t offset=0; offset<input.size(); offset+=step) {
+        auto chunk = input.subspan(offset, std::min(step, input.size() - offset));
+        uint8_t padding = 0;
+        auto space = writer.reserve(comp.compressBound(chunk.size()));
+        size_t written = comp.compress(chunk, space, padding);
+        writer.commit(written, padding, chunk.size());
+    }
+}
+
+void ThreadedCompressor::writeChunks(std::span<const uint8_t> input, ArchiveWriter& writer) {
+    if (runsInline(input.size())) {
+        inline_calls_++;
+        auto comp = borrowCompressor();
+        compressChunks(*comp, input, writer);
+        returnCompressor(std::move(comp));
+        return;
+    }
+    compressData(input, [&writer](Compressor::EncodedData&& encoded, size_t original_size) {
+        writer.add(encoded.bits, encoded.padding, original_size);
+    });
+}
+
+std::vector<Archive::Entry> ThreadedCompressor::readEntries(std::span<const uint8_t> archive) const {
+    auto entries = Archive::readIndex(archive);
+    for (const auto& entry : entries) {
+        if (entry.original_size > compressor->decompressBound(archive.subspan(entry.offset, entry.compressed_size))) {
+            throw std::runtime_error("Corrupt archive: chunk larger than its payload can decode to");
+        }
+    }
+    size_t max_output = max_output_;
+    if (Archive::originalSize(entries) > max_output) {
+        throw std::length_error("Archive decompresses to more than " + std::to_string(max_output) + " bytes");
+    }
+    return entries;
+}
+
+std::vector<uint8_t> ThreadedCompressor::decompressArchive(Compressor& comp, std::span<const uint8_t> archive,
+                                                           const std::vector<Archive::Entry>& entries) const {
+    std::vector<uint8_t> out(Archive::originalSize(entries));
+
+    comp.resetStream();
+    size_t pos = 0;
+    for (const auto& entry : entries) {
+        auto target = chunkTarget(out, pos, entry.original_size);
+        size_t written = comp.decompress(archive.subspan(entry.offset, entry.compressed_size), entry.padding, target);
+        if (written!=entry.original_size) {
+            throw std::runtime_error("Corrupt archive: chunk decoded to the wrong size");
+        }
+        pos += written;
+    }
+    return out;
+}
+
+std::vector<uint8_t> ThreadedCompressor::compress(std::span<const uint8_t> input) {
+    if (runsInline(input.size())) {
+        inline_calls_++;
+        auto comp = borrowCompressor();
+        auto out = compressArchive(*comp, input);
+        returnCompressor(std::move(comp));
+        return out;
+    }
+
+    std::vector<uint8_t> out;
+    ArchiveWriter writer(out);
+    writeChunks(input, writer);
+    writer.finish();
+    return out;
+}
+
+std::vector<uint8_t> ThreadedCompressor::appendTail(std::vector<Archive::Entry> entries, uint64_t payload_end,
+                                                    std::span<const uint8_t> data) {
+    std::vector<uint8_t> tail;
+    ArchiveWriter writer(tail, std::move(entries), payload_end);
+    writeChunks(data, writer);
+    writer.finish();
+    return tail;
+}
+
+void ThreadedCompressor::append(std::vector<uint8_t>& archive, std::span<const uint8_t> data) {
+    auto entries = Archive::readIndex(archive);
+    uint64_t payload_end = Archive::readFooter(archive);
+
+    // compress before touching the archive, a failure leaves it as it was
+    auto tail = appendTail(std::move(entries), payload_end, data);
+    archive.resize(payload_end);
+    archive.insert(archive.end(), tail.begin(), tail.end());
+}
+
+void ThreadedCompressor::appendFile(const std::string& archive_path, std::span<const uint8_t> data) {
+    if (!std::filesystem::exists(archive_path)) {
+        FileIO::writeFile(archive_path, compress(data));
+        return;
+    }
+
+    std::fstream file(archive_path, std::ios::binary | std::ios::in | std::ios::out);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open archive: " + archive_path);
+    }
+    uint64_t size = std::filesystem::file_size(archive_path);
+    if (size < Archive::kFooterSize) {
+        throw std::runtime_error("Corrupt archive: missing footer");
+    }
+
+    // only the footer and the index are read, the payloads stay on disk untouched
+    std::vector<uint8_t> footer(Archive::kFooterSize);
+    file.seekg(size - Archive::kFooterSize);
+    file.read(reinterpret_cast<char*>(footer.data()), footer.size());
+    uint64_t index_offset = Archive::readFooter(footer);
+    if (!file || index_offset > size - Archive::kFooterSize) {
+        throw std::runtime_error("Corrupt archive: index offset out of range");
+    }
+
+    std::vector<uint8_t> index(size - Archive::kFooterSize - index_offset);
+    file.seekg(index_offset);
+    file.read(reinterpret_cast<char*>(index.data()), index.size());
+    if (!file) {
+        throw std::runtime_error("Could not read archive index: " + archive_path);
+    }
+    auto tail = appendTail(Archive::parseIndex(index, index_offset), index_offset, data);
+
+    // the new index lists at least the old entries, so the tail always covers the old index
+    file.seekp(index_offset);
+    file.write(reinterpret_cast<const char*>(tail.data()), tail.size());
+    file.flush();
+    if (!file) {
+        throw std::runtime_error("Could not write archive: " + archive_path);
+    }
+}
+
+std::vector<uint8_t> ThreadedCompressor::decompress(std::span<const uint8_t> archive) {
+    auto entries = readEntries(archive);
+    uint64_t total = Archive::originalSize(entries);
+
+    if (runsInline(total) || (entries.size() < 2 && !throttled_)) {
+        inline_calls_++;
+        auto comp = borrowCompressor();
+        auto out = decompressArchive(*comp, archive, entries);
+        returnCompressor(std::move(comp));
+        return out;
+    }
+
+    // original sizes are known, so every run of chunks decodes straight into its place in the output
+    auto starts = runStarts(entries.size(), [&](size_t i) {
+        return archive.subspan(entries[i].offset, entries[i].compressed_size);
+    });
+    // runs are charged their compressed and decoded bytes like compressData charges chunks,
+    // blocking on the budget only with none of ours left to finish
+    std::vector<uint8_t> out(total);
+    std::vector<Result> results(starts.size());
+    std::vector<size_t> costs(starts.size());
+    Batch batch;
+    size_t pos = 0;
+    size_t finished = 0;
+    size_t charged = 0;
+    try {
+        for (size_t r=0; r<starts.size(); ++r) {
+            size_t first = starts[r];
+            size_t end = r + 1 < starts.size() ? starts[r + 1] : entries.size();
+            size_t bytes = 0;
+            size_t cost = 0;
+            for (size_t i=first; i<end; ++i) {
+                bytes += entries[i].original_size;
+                cost += entries[i].compressed_size + entries[i].original_size;
+            }
+            while (!budget_.tryAcquire(cost)) {
+                if (finished==r) {
+                    budget_.acquire(cost);
+                    break;
+                }
+                {
+                    std::unique_lock<std::mutex> lock(batch.mutex);
+                    batch.cv.wait(lock, [&]() { return results[finished].done || batch.error; });
+                    if (batch.error) {
+                        std::rethrow_exception(batch.error);
+                    }
+                }
+                budget_.release(costs[finished]);
+                charged -= costs[finished];
+                finished++;
+            }
+            costs[r] = cost;
+            charged += cost;
+
+            Task task{first, archive};
+            task.entries = std::span<const Archive::Entry>(entries).subspan(first, end - first);
+            task.output = chunkTarget(out, pos, bytes);
+            task.is_decompression = true;
+            task.result = &results[r];
+            task.batch = &batch;
+            submit(task);
+            pos += bytes;
+        }
+        waitForBatch(batch);
+    }
+    catch (...) {
+        // tasks still point at this frame's results, let them finish first
+        std::unique_lock<std::mutex> lock(batch.mutex);
+        batch.cv.wait(lock, [&batch]() { return batch.pending==0; });
+        budget_.release(charged);
+        throw;
+    }
+    budget_.release(charged);
+    return out;
+}
+
+std::vector<std::vector<uint8_t>> ThreadedCompressor::compressBatch(const std::vector<std::span<const uint8_t>>& inputs) {
+    return runBatch(inputs, false);
+}
+
+std::vector<std::vector<uint8_t>> ThreadedCompressor::decompressBatch(const std::vector<std::span<const uint8_t>>& archives) {
+    return runBatch(archives, true);
+}
+
+std::vector<std::vector<uint8_t>> ThreadedCompressor::runBatch(const std::vector<std::span<const uint8_t>>& inputs,
+                                                               bool decompress) {
+    std::vector<std::vector<uint8_t>> outputs(inputs.size());
+    if (inputs.empty()) return outputs;
+
+    size_t total = 0;
+    for (const auto& input : inputs) {
+        total += input.size();
+    }
+    // a few groups per worker balance the load, but each group stays big enough
+    // that queue traffic does not dominate thousands of tiny buffers
+    const size_t group_bytes = std::clamp<size_t>(total / (workers_.size() * 4), 4096, 1024 * 1024);
+
+    std::span<const std::span<const uint8_t>> all(inputs);
+    std::span<std::vector<uint8_t>> results(outputs);
+    std::vector<Result> group_results(inputs.size());
+    Batch batch;
+
+    size_t first = 0;
+    size_t groups = 0;
+    while (first < inputs.size()) {
+        size_t last = first;
+        size_t bytes = 0;
+        while (last < inputs.size() && (last==first || bytes + inputs[last].size() <= group_bytes)) {
+            bytes += inputs[last].size();
+            last++;
+        }
+
+        Task task{groups, {}};
+        task.batch_inputs = all.subspan(first, last - first);
+        task.batch_outputs = results.subspan(first, last - first);
+        task.is_decompression = decompress;
+        task.result = &group_results[groups];
+        task.batch = &batch;
+        submit(task);
+
+        groups++;
+        first = last;
+    }
+    waitForBatch(batch);
+    return outputs;
+}
+
+ThreadedCompressor::Metrics ThreadedCompressor::getMetrics() const {
+    Metrics metrics;
+    metrics.chunks_compressed = chunks_compressed_;
+    metrics.chunks_decompressed = chunks_decompressed_;
+    metrics.inline_calls = inline_calls_;
+    metrics.buffer_allocations = input_pool_.getAllocations();
+    for (const auto& worker : workers_) {
+        metrics.buffer_allocations += worker->pool.getAllocations();
+    }
+    metrics.chunk_size = last_chunk_size_;
+    metrics.thread_count = last_thread_count_;
+    metrics.memory = budget_.usage();
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        metrics.active_workers = active_workers_;
+    }
+    metrics.throttled = throttle_.getWaited();
+    return metrics;
+}
+
+void ThreadedCompressor::setQos(const Qos& qos) {
+    std::lock_guard<std::mutex> qos_lock(qos_mutex_);
+    size_t active = qos.max_workers==kAuto ? workers_.size() : std::min(qos.max_workers, workers_.size());
+    throttle_.setRate(qos.bytes_per_second);
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        active_workers_ = active;
+    }
+    queue_cv_.notify_all();
+    qos_.max_workers = qos.max_workers;
+    qos_.bytes_per_second = qos.bytes_per_second;
+
+    // a refused priority change keeps the old one, so count either as a limit until it is done
+    bool limited = active < workers_.size() || qos.bytes_per_second!=RateLimiter::kUnlimited;
+    throttled_ = limited || qos.priority!=Priority::Normal || qos_.priority!=Priority::Normal;
+
+    if (qos.priority==qos_.priority) return;
+    for (size_t i=0; i<workers_.size(); ++i) {
+        try {
+            setThreadPriority(workers_[i]->tid, qos.priority);
+        }
+        catch (const std::system_error&) {
+            // workers share their credentials, so a refusal normally comes on the first one;
+            // put back any already moved, which may itself be refused when it means going up
+            for (size_t k=0; k<i; ++k) {
+                try {
+                    setThreadPriority(workers_[k]->tid, qos_.priority);
+                }
+                catch (const std::system_error&) {
+                }
+            }
+            throw;
+        }
+    }
+    qos_.priority = qos.priority;
+    throttled_ = limited || qos.priority!=Priority::Normal;
+}
+
+ThreadedCompressor::Qos ThreadedCompressor::getQos() const {
+    std::lock_guard<std::mutex> lock(qos_mutex_);
+    return qos_;
+}
+
+void ThreadedCompressor::setMemoryBudget(size_t bytes) {
+    budget_.setLimit(bytes);
+}
+
+void ThreadedCompressor::setMaxOutputSize(size_t bytes) {
+    max_output_ = bytes;
+}
+
+size_t ThreadedCompressor::chunkCost(size_t input_size) const {
+    return input_size + compressor->compressBound(input_size);
+}
+
+void ThreadedCompressor::setLog(std::ostream* log) {
+    log_ = log;
+}
@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+#include "archive.h"
+
+TEST(ArchiveTest, WriterRoundTripsIndex) {
+    std::vector<uint8_t> out;
+    ArchiveWriter writer(out);
+    writer.add(std::vector<uint8_t>{1, 2, 3}, 5, 10);
+    writer.add(std::vector<uint8_t>{4, 5}, 0, 300);
+    writer.finish();
+
+    auto entries = Archive::readIndex(out);
+    ASSERT_EQ(entries.size(), 2u);
+
+    EXPECT_EQ(entries[0].offset, 0u);
+    EXPECT_EQ(entries[0].compressed_size, 3u);
+    EXPECT_EQ(entries[0].original_size, 10u);
+    EXPECT_EQ(entries[0].padding, 5);
+
+    EXPECT_EQ(entries[1].offset, 3u);
+    EXPECT_EQ(entries[1].compressed_size, 2u);
+    EXPECT_EQ(entries[1].original_size, 300u);
+    EXPECT_EQ(Archive::originalSize(entries), 310u);
+
+    EXPECT_EQ(Archive::readFooter(out), 5u);
+}
+
+TEST(ArchiveTest, ReserveAndCommitKeepOnlyWrittenBytes) {
+    std::vector<uint8_t> out;
+    ArchiveWriter writer(out);
+    auto space = writer.reserve(100);
+    space[0] = 42;
+    writer.commit(1, 3, 8);
+    writer.finish();
+
+    auto entries = Archive::readIndex(out);
+    ASSERT_EQ(entries.size(), 1u);
+    EXPECT_EQ(entries[0].compressed_size, 1u);
+    EXPECT_EQ(out[0], 42);
+}
+
+TEST(ArchiveTest, EmptyArchive) {
+    std::vector<uint8_t> out;
+    ArchiveWriter writer(out);
+    writer.finish();
+
+    EXPECT_EQ(out.size(), 1 + Archive::kFooterSize);
+    EXPECT_TRUE(Archive::readIndex(out).empty());
+}
+
+TEST(ArchiveTest, BadMagicThrows) {
+    std::vector<uint8_t> out;
+    ArchiveWriter writer(out);
+    writer.finish();
+    out.back() = 'X';
+
+    EXPECT_THROW(Archive::readIndex(out), std::runtime_error);
+}
+
+TEST(ArchiveTest, TruncatedArchiveThrows) {
+    std::vector<uint8_t> out;
+    ArchiveWriter writer(out);
+    writer.add(std::vector<uint8_t>{1, 2, 3}, 0, 3);
+    writer.finish();
+
+    std::vector<uint8_t> truncated(out.begin() + 1, out.end());
+    EXPECT_THROW(Archive::readIndex(truncated), std::runtime_error);
+    EXPECT_THROW(Archive::readIndex(std::vector<uint8_t>{1, 2}), std::runtime_error);
+}
+
+TEST(ArchiveTest, WrappingOriginalSizesThrow) {
+    // three chunks whose original sizes add up to 16 modulo 2^64
+    std::vector<uint8_t> out;
+    ArchiveWriter writer(out);
+    writer.add(std::vector<uint8_t>{1}, 0, size_t{1} << 63);
+    writer.add(std::vector<uint8_t>{2}, 0, size_t{1} << 63);
+    writer.add(std::vector<uint8_t>{3}, 0, 16);
+    writer.finish();
+
+    EXPECT_THROW(Archive::readIndex(out), std::runtime_error);
+
+    std::vector<Archive::Entry> entries = {{0, 1, size_t{1} << 63, 0}, {1, 1, size_t{1} << 63, 0}};
+    EXPECT_THROW(Archive::originalSize(entries), std::runtime_error);
+}
+
+TEST(ArchiveTest, WriterContinuesExistingArchive) {
+    std::vector<uint8_t> out;
+    ArchiveWriter writer(out);
+    writer.add(std::vector<uint8_t>{1, 2, 3}, 1, 4);
+    writer.finish();
+
+    // drop the index and keep writing after the existing payloads
+    auto entries = Archive::readIndex(out);
+    uint64_t payload_end = Archive::readFooter(out);
+    std::vector<uint8_t> tail;
+    ArchiveWriter appender(tail, entries, payload_end);
+    appender.add(std::vector<uint8_t>{9, 8}, 2, 5);
+    appender.finish();
+
+    out.resize(payload_end);
+    out.insert(out.end(), tail.begin(), tail.end());
+
+    auto appended = Archive::readIndex(out);
+    ASSERT_EQ(appended.size(), 2u);
+    EXPECT_EQ(appended[1].offset, 3u);
+    EXPECT_EQ(out[3], 9);
+    EXPECT_EQ(appended[1].padding, 2);
+    EXPECT_EQ(Archive::originalSize(appended), 9u);
+}
@@ -0,0 +1,155 @@
+#include <gtest/gtest.h>
+#include "threaded_compressor.h"
+#include <future>
+#include <system_error>
+
+namespace {
+    std::vector<uint8_t> sampleData(size_t size) {
+        std::vector<uint8_t> data(size);
+        for (size_t i = 0; i < size; ++i) {
+            data[i] = static_cast<uint8_t>("pack my box with five dozen liquor jugs"[i % 39] + (i / 1013) % 5);
+        }
+        return data;
+    }
+
+    // fire-and-forget coroutine, enough to drive co_await in a test
+    struct Detached {
+        struct promise_type {
+            Detached get_return_object() { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+    };
+
+    Detached roundTrip(ThreadedCompressor& tc, std::vector<uint8_t> data, std::promise<std::vector<uint8_t>>& done) {
+        auto archive = co_await tc.compressAsync(std::move(data));
+        auto restored = co_await tc.decompressAsync(std::move(archive));
+        done.set_value(std::move(restored));
+    }
+}
+
+TEST(AsyncJobTest, GetRoundTrip) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 4096, 3);
+    auto data = sampleData(100'000);
+
+    auto archive = tc.compressAsync(data).get();
+    EXPECT_EQ(archive, tc.compress(data));
+    EXPECT_EQ(tc.decompressAsync(archive).get(), data);
+}
+
+TEST(AsyncJobTest, CallbacksReportEveryChunk) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 4096, 3);
+    auto data = sampleData(50'000);
+
+    std::vector<AsyncJob::Progress> reports;
+    std::promise<std::vector<uint8_t>> completed;
+    AsyncJob::Options options;
+    options.on_progress = [&reports](const AsyncJob::Progress& progress) { reports.push_back(progress); };
+    options.on_complete = [&completed](std::vector<uint8_t>&& output, std::exception_ptr error) {
+        EXPECT_FALSE(error);
+        completed.set_value(std::move(output));
+    };
+
+    auto job = tc.compressAsync(data, options);
+    auto archive = completed.get_future().get();
+    EXPECT_EQ(tc.decompress(archive), data);
+
+    ASSERT_EQ(reports.size(), 13u);
+    for (size_t i = 0; i < reports.size(); ++i) {
+        EXPECT_EQ(reports[i].chunks_done, i + 1);
+        EXPECT_EQ(reports[i].chunks_total, 13u);
+        EXPECT_EQ(reports[i].bytes_total, data.size());
+    }
+    EXPECT_EQ(reports.back().bytes_done, data.size());
+
+    auto progress = job.getProgress();
+    EXPECT_EQ(progress.chunks_done, progress.chunks_total);
+}
+
+TEST(AsyncJobTest, CoAwait) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 4096, 2);
+    auto data = sampleData(30'000);
+
+    std::promise<std::vector<uint8_t>> done;
+    roundTrip(tc, data, done);
+    EXPECT_EQ(done.get_future().get(), data);
+}
+
+TEST(AsyncJobTest, CancelStopsQueuedChunks) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 4096, 1);
+
+    // hold the only worker inside a progress callback while the second job is queued
+    std::promise<void> release;
+    std::promise<void> blocking;
+    AsyncJob::Options hold;
+    hold.on_progress = [&](const AsyncJob::Progress&) {
+        blocking.set_value();
+        release.get_future().wait();
+    };
+    auto first = tc.compressAsync(sampleData(1000), hold);
+    blocking.get_future().wait();
+
+    auto second = tc.compressAsync(sampleData(100'000));
+    second.cancel();
+    release.set_value();
+
+    try {
+        second.get();
+        FAIL() << "cancelled job returned a result";
+    }
+    catch (const std::system_error& e) {
+        EXPECT_EQ(e.code(), std::errc::operation_canceled);
+    }
+    EXPECT_EQ(second.getProgress().chunks_done, 0u);
+    EXPECT_FALSE(first.get().empty());
+}
+
+TEST(AsyncJobTest, CorruptArchiveFailsJob) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 4096, 2);
+    std::vector<uint8_t> garbage = {1, 2, 3};
+
+    auto job = tc.decompressAsync(garbage);
+    EXPECT_TRUE(job.isDone());
+    EXPECT_THROW(job.get(), std::runtime_error);
+}
+
+TEST(AsyncJobTest, ThrowingCompletionFailsJob) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 4096, 2);
+    AsyncJob::Options options;
+    options.on_complete = [](std::vector<uint8_t>&&, std::exception_ptr) {
+        throw std::logic_error("callback failed");
+    };
+
+    auto job = tc.compressAsync(sampleData(50'000), options);
+    EXPECT_THROW(job.get(), std::logic_error);
+    EXPECT_TRUE(job.isDone());
+
+    // the job's own error wins over the callback's
+    std::vector<uint8_t> garbage = {1, 2, 3};
+    auto failed = tc.decompressAsync(garbage, options);
+    EXPECT_THROW(failed.get(), std::runtime_error);
+}
+
+TEST(AsyncJobTest, EmptyInputCompletesImmediately) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 4096, 2);
+
+    auto job = tc.compressAsync({});
+    EXPECT_TRUE(job.isDone());
+    EXPECT_TRUE(tc.decompressAsync(job.get()).get().empty());
+}
+
+TEST(AsyncJobTest, ConcurrentJobsShareThePool) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 4096, 4);
+
+    std::vector<std::vector<uint8_t>> inputs;
+    std::vector<AsyncJob> jobs;
+    for (size_t i = 0; i < 16; ++i) {
+        inputs.push_back(sampleData(10'000 + i * 3000));
+        jobs.push_back(tc.compressAsync(inputs.back()));
+    }
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        EXPECT_EQ(tc.decompress(jobs[i].get()), inputs[i]);
+    }
+}
@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+#include "auto_tuner.h"
+
+namespace {
+    AutoTuner::MachineInfo machine(size_t cores) {
+        return AutoTuner::MachineInfo{cores, 2 * 1024 * 1024, 32 * 1024 * 1024};
+    }
+}
+
+TEST(AutoTunerTest, DetectReportsSaneMachine) {
+    auto info = AutoTuner::MachineInfo::detect();
+
+    EXPECT_GE(info.cores, 1u);
+    EXPECT_GT(info.l2_cache_bytes, 0u);
+    EXPECT_GT(info.l3_cache_bytes, 0u);
+}
+
+TEST(AutoTunerTest, SmallInputUsesFewThreads) {
+    AutoTuner tuner(100 * 1024, 16, machine(16));
+
+    EXPECT_EQ(tuner.getThreadCount(), 2u);
+    EXPECT_EQ(tuner.getChunkSize(), AutoTuner::kMinChunkSize);
+}
+
+TEST(AutoTunerTest, LargeInputCappedByCache) {
+    AutoTuner tuner(1024ull * 1024 * 1024, 8, machine(8));
+
+    EXPECT_EQ(tuner.getThreadCount(), 8u);
+    // half of L2 holds the chunk and its output buffer
+    EXPECT_EQ(tuner.getChunkSize(), 1024u * 1024);
+}
+
+TEST(AutoTunerTest, ThreadsNeverExceedWorkers) {
+    AutoTuner tuner(1024ull * 1024 * 1024, 4, machine(64));
+
+    EXPECT_EQ(tuner.getThreadCount(), 4u);
+    EXPECT_EQ(tuner.getWindow(), 8u);
+}
+
+TEST(AutoTunerTest, FastChunksGrow) {
+    AutoTuner tuner(1024ull * 1024 * 1024, 2, machine(2));
+    size_t before = tuner.getChunkSize();
+
+    // 1 ns per byte is far below the minimum chunk time
+    for (int i = 0; i < 2; ++i) {
+        tuner.record(before, std::chrono::nanoseconds(before / 10), 4);
+    }
+    EXPECT_EQ(tuner.getChunkSize(), before * 2);
+    EXPECT_EQ(tuner.getAdjustments(), 1u);
+}
+
+TEST(AutoTunerTest, SlowChunksWithIdleWorkersShrink) {
+    AutoTuner tuner(1024ull * 1024 * 1024, 2, machine(2));
+    size_t before = tuner.getChunkSize();
+
+    for (int i = 0; i < 2; ++i) {
+        tuner.record(before, std::chrono::milliseconds(100), 0);
+    }
+    EXPECT_EQ(tuner.getChunkSize(), before / 2);
+}
+
+TEST(AutoTunerTest, ChunkSizeStaysWithinBounds) {
+    AutoTuner tuner(0, 1, machine(1));
+
+    for (int i = 0; i < 100; ++i) {
+        tuner.record(tuner.getChunkSize(), std::chrono::seconds(1), 0);
+    }
+    EXPECT_EQ(tuner.getChunkSize(), AutoTuner::kMinChunkSize);
+
+    for (int i = 0; i < 100; ++i) {
+        tuner.record(tuner.getChunkSize(), std::chrono::nanoseconds(1), 1);
+    }
+    EXPECT_EQ(tuner.getChunkSize(), AutoTuner::kMaxChunkSize);
+}
@@ -0,0 +1,167 @@
+#include <gtest/gtest.h>
+#include "block_sort.h"
+#include "huffman.h"
+#include "threaded_compressor.h"
+#include <random>
+#include <string>
+
+namespace {
+    std::vector<uint8_t> bytes(const std::string& text) {
+        return std::vector<uint8_t>(text.begin(), text.end());
+    }
+
+    std::vector<uint8_t> textData(size_t size) {
+        const std::string words[] = {"the ", "compressor ", "sorts ", "blocks ", "of ", "text ", "and ", "then ",
+                                     "codes ", "ranks\n"};
+        std::mt19937 rng(7);
+        std::vector<uint8_t> data;
+        while (data.size() < size) {
+            const auto& word = words[rng() % 10];
+            data.insert(data.end(), word.begin(), word.end());
+        }
+        data.resize(size);
+        return data;
+    }
+
+    std::vector<uint8_t> randomData(size_t size, unsigned int seed) {
+        std::mt19937 rng(seed);
+        std::vector<uint8_t> data(size);
+        for (auto& byte : data) {
+            byte = static_cast<uint8_t>(rng());
+        }
+        return data;
+    }
+
+    std::vector<uint8_t> transformRoundTrip(const std::vector<uint8_t>& input) {
+        std::vector<int32_t> suffixes;
+        std::vector<uint32_t> links;
+        std::vector<uint8_t> bwt(input.size());
+        uint32_t primary = BlockSort::transform(input, bwt, suffixes);
+
+        std::vector<uint8_t> restored(input.size());
+        BlockSort::inverseTransform(bwt, primary, restored, links);
+        return restored;
+    }
+}
+
+TEST(BlockSortTest, TransformOfBanana) {
+    // rotations of banana$ sorted: $banana a$banan ana$ban anana$b banana$ na$bana nana$ba
+    std::vector<int32_t> scratch;
+    std::vector<uint8_t> out(6);
+    uint32_t primary = BlockSort::transform(bytes("banana"), out, scratch);
+
+    EXPECT_EQ(out, bytes("annbaa"));
+    EXPECT_EQ(primary, 4u);
+
+    std::vector<uint32_t> links;
+    std::vector<uint8_t> restored(6);
+    BlockSort::inverseTransform(out, primary, restored, links);
+    EXPECT_EQ(restored, bytes("banana"));
+}
+
+TEST(BlockSortTest, TransformRoundTripsAwkwardInputs) {
+    std::vector<std::vector<uint8_t>> inputs = {
+        bytes("a"), bytes("ab"), bytes("ba"), bytes("aaaaaaaaaa"), bytes("abababababab"),
+        bytes("mississippi"), std::vector<uint8_t>(1000, 0), std::vector<uint8_t>(1000, 255),
+        randomData(5000, 1), textData(20000),
+    };
+    // two letter strings recurse deepest in the suffix sort
+    std::mt19937 rng(5);
+    for (int i = 0; i < 300; ++i) {
+        std::vector<uint8_t> input(1 + rng() % 80);
+        for (auto& byte : input) {
+            byte = "ab"[rng() % 2];
+        }
+        inputs.push_back(input);
+    }
+    for (const auto& input : inputs) {
+        EXPECT_EQ(transformRoundTrip(input), input) << "size " << input.size();
+    }
+}
+
+TEST(BlockSortTest, RanksRoundTrip) {
+    std::vector<uint8_t> data(3000, 'x');
+    auto noise = randomData(2000, 3);
+    data.insert(data.end(), noise.begin(), noise.end());
+    for (int i = 0; i < 256; ++i) {
+        data.push_back(static_cast<uint8_t>(255 - i));   // ranks up to 255
+    }
+
+    std::vector<uint8_t> ranks;
+    BlockSort::encodeRanks(data, ranks);
+
+    std::vector<uint8_t> restored(data.size());
+    BlockSort::decodeRanks(ranks, restored);
+    EXPECT_EQ(restored, data);
+
+    std::vector<uint8_t> wrong_size(data.size() + 1);
+    EXPECT_THROW(BlockSort::decodeRanks(ranks, wrong_size), std::runtime_error);
+}
+
+TEST(BlockSortTest, LongZeroRunsBecomeFewSymbols) {
+    std::vector<uint8_t> ranks;
+    BlockSort::encodeRanks(std::vector<uint8_t>(1 << 20, 0), ranks);
+    EXPECT_LE(ranks.size(), 20u);
+}
+
+TEST(BlockSortTest, CompressRoundTrip) {
+    BlockSort stage(std::make_unique<Huffman>());
+    for (size_t size : {0, 1, 2, 100, 4096, 100000}) {
+        auto input = textData(size);
+        auto encoded = stage.compress(input);
+        EXPECT_LE(encoded.bits.size(), stage.compressBound(size));
+        EXPECT_EQ(stage.decompress(encoded), input) << "size " << size;
+        EXPECT_GE(stage.decompressBound(encoded.bits), size);
+
+        std::vector<uint8_t> out(size);
+        EXPECT_EQ(stage.decompress(encoded.bits, encoded.padding, out), size);
+        EXPECT_EQ(out, input);
+    }
+}
+
+TEST(BlockSortTest, ChunkSpanningSeveralBlocks) {
+    BlockSort stage(std::make_unique<Huffman>());
+    auto input = textData(BlockSort::kBlockSize * 2 + 12345);
+
+    auto encoded = stage.compress(input);
+    EXPECT_EQ(encoded.bits[0], BlockSort::Transformed);
+    EXPECT_EQ(stage.decompress(encoded), input);
+}
+
+TEST(BlockSortTest, BeatsPlainHuffmanOnText) {
+    auto input = textData(200000);
+    Huffman plain;
+    BlockSort stage(std::make_unique<Huffman>());
+
+    EXPECT_LT(stage.compress(input).bits.size(), plain.compress(input).bits.size() / 2);
+}
+
+TEST(BlockSortTest, RandomDataFallsBackToRaw) {
+    BlockSort stage(std::make_unique<Huffman>());
+    auto input = randomData(50000, 9);
+
+    auto encoded = stage.compress(input);
+    EXPECT_EQ(encoded.bits[0], BlockSort::Raw);
+    EXPECT_EQ(stage.decompress(encoded), input);
+    EXPECT_GE(stage.decompressBound(encoded.bits), input.size());
+}
+
+TEST(BlockSortTest, CorruptPrimaryIndexThrows) {
+    BlockSort stage(std::make_unique<Huffman>());
+    auto encoded = stage.compress(textData(5000));
+    ASSERT_EQ(encoded.bits[0], BlockSort::Transformed);
+
+    // first primary index follows the kind byte and the two sizes
+    encoded.bits[9] = 0xFF;
+    encoded.bits[10] = 0xFF;
+    EXPECT_THROW(stage.decompress(encoded), std::runtime_error);
+}
+
+TEST(BlockSortTest, RunsOnTheWorkerPool) {
+    ThreadedCompressor tc(std::make_unique<BlockSort>(std::make_unique<Huffman>()), 16 * 1024, 3);
+    auto input = textData(300000);
+
+    auto archive = tc.compress(input);
+    EXPECT_EQ(tc.decompress(archive), input);
+    EXPECT_EQ(tc.getMetrics().chunks_compressed, 19u);
+}
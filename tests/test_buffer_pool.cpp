@@ -0,0 +1,42 @@
+#include <gtest/gtest.h>
+#include "buffer_pool.h"
+
+TEST(BufferPoolTest, AcquireReturnsRequestedSize) {
+    BufferPool pool;
+    auto buffer = pool.acquire(128);
+
+    EXPECT_EQ(buffer.size(), 128u);
+    EXPECT_EQ(pool.getAllocations(), 1u);
+}
+
+TEST(BufferPoolTest, ReleasedBufferIsReused) {
+    BufferPool pool;
+    auto buffer = pool.acquire(256);
+    const uint8_t* address = buffer.data();
+    pool.release(std::move(buffer));
+
+    auto again = pool.acquire(200);
+    EXPECT_EQ(again.data(), address);
+    EXPECT_EQ(again.size(), 200u);
+    EXPECT_EQ(pool.getAllocations(), 1u);
+}
+
+TEST(BufferPoolTest, TooSmallBufferGrows) {
+    BufferPool pool;
+    pool.release(pool.acquire(16));
+
+    auto buffer = pool.acquire(1024);
+    EXPECT_EQ(buffer.size(), 1024u);
+    EXPECT_EQ(pool.getAllocations(), 2u);
+}
+
+TEST(BufferPoolTest, SteadyStateDoesNotAllocate) {
+    BufferPool pool;
+    for (int i = 0; i < 100; ++i) {
+        auto a = pool.acquire(4096);
+        auto b = pool.acquire(4096);
+        pool.release(std::move(a));
+        pool.release(std::move(b));
+    }
+    EXPECT_EQ(pool.getAllocations(), 2u);
+}
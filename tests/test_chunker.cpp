@@ -97,3 +97,18 @@ TEST(ChunkerTest, LargeInputSplitsCorrectly)
     }
 }
 
+
+TEST(ChunkerTest, ViewMatchesSplit) {
+    std::vector<uint8_t> data = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+
+    Chunker chunker(4);
+    auto copies = chunker.split(data);
+    auto views = chunker.view(data);
+
+    ASSERT_EQ(views.size(), copies.size());
+    for (size_t i = 0; i < views.size(); ++i) {
+        EXPECT_TRUE(std::equal(views[i].begin(), views[i].end(), copies[i].data.begin(), copies[i].data.end()));
+        // views point into the input rather than copying it
+        EXPECT_EQ(views[i].data(), data.data() + i * 4);
+    }
+}
@@ -0,0 +1,239 @@
+#include <gtest/gtest.h>
+#include "compression_daemon.h"
+#include <filesystem>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+    std::vector<uint8_t> sampleData(size_t size) {
+        std::vector<uint8_t> data(size);
+        for (size_t i = 0; i < size; ++i) {
+            data[i] = static_cast<uint8_t>("daemon jobs share one warm pool"[i % 31] + (i / 1013) % 5);
+        }
+        return data;
+    }
+
+    std::string socketPath(const std::string& name) {
+        return (std::filesystem::temp_directory_path() / (name + "-" + std::to_string(getpid()) + ".sock")).string();
+    }
+
+    // a pipe the test holds both ends of, passed to the daemon by path
+    struct StalledPipe {
+        int fds[2] = {-1, -1};
+
+        StalledPipe() {
+            EXPECT_EQ(pipe(fds), 0);
+        }
+        ~StalledPipe() {
+            close(fds[0]);
+            close(fds[1]);
+        }
+        std::string readEnd() const {
+            return "/proc/self/fd/" + std::to_string(fds[0]);
+        }
+        std::string writeEnd() const {
+            return "/proc/self/fd/" + std::to_string(fds[1]);
+        }
+    };
+}
+
+TEST(CompressionDaemonTest, BufferRoundTrip) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 16 * 1024, 2);
+    CompressionDaemon daemon(tc, socketPath("mtc-buffers"));
+    DaemonClient client(socketPath("mtc-buffers"));
+
+    for (size_t size : {0, 100, 5000, 300000}) {
+        auto data = sampleData(size);
+        auto archive = client.compress(data);
+        EXPECT_EQ(tc.decompress(archive), data);
+        EXPECT_EQ(client.decompress(archive), data);
+    }
+    EXPECT_EQ(daemon.requestsServed(), 8u);
+}
+
+TEST(CompressionDaemonTest, FileRoundTrip) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 16 * 1024, 2);
+    CompressionDaemon daemon(tc, socketPath("mtc-files"));
+    DaemonClient client(socketPath("mtc-files"));
+
+    auto data = sampleData(200000);
+    FileIO::writeFile("daemon_input.bin", data);
+    uint64_t written = client.compressFile("daemon_input.bin", "daemon_input.mtc");
+    EXPECT_EQ(std::filesystem::file_size("daemon_input.mtc"), written);
+    EXPECT_EQ(client.decompressFile("daemon_input.mtc", "daemon_output.bin"), data.size());
+    EXPECT_EQ(FileIO::readFile("daemon_output.bin"), data);
+
+    std::filesystem::remove("daemon_input.bin");
+    std::filesystem::remove("daemon_input.mtc");
+    std::filesystem::remove("daemon_output.bin");
+}
+
+TEST(CompressionDaemonTest, InputShrinkingDuringARequest) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 16 * 1024, 2);
+    CompressionDaemon daemon(tc, socketPath("mtc-shrink"));
+    DaemonClient client(socketPath("mtc-shrink"));
+
+    // a file truncated while the daemon reads it must not take the daemon down
+    FileIO::writeFile("daemon_shrink.bin", sampleData(32 << 20));
+    std::thread truncater([]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        std::filesystem::resize_file("daemon_shrink.bin", 0);
+    });
+    try {
+        client.compressFile("daemon_shrink.bin", "daemon_shrink.mtc");
+    }
+    catch (const std::runtime_error&) {
+    }
+    truncater.join();
+    EXPECT_EQ(client.decompress(client.compress(sampleData(1000))), sampleData(1000));
+
+    std::filesystem::remove("daemon_shrink.bin");
+    std::filesystem::remove("daemon_shrink.mtc");
+}
+
+TEST(CompressionDaemonTest, ErrorsReachTheClient) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 16 * 1024, 2);
+    CompressionDaemon daemon(tc, socketPath("mtc-errors"));
+    DaemonClient client(socketPath("mtc-errors"));
+
+    std::vector<uint8_t> garbage = {1, 2, 3, 4, 5};
+    EXPECT_THROW(client.decompress(garbage), std::runtime_error);
+    EXPECT_THROW(client.compressFile("daemon_missing_input.bin", "daemon_missing.mtc"), std::system_error);
+
+    // the connection stays usable after a failed request
+    auto data = sampleData(1000);
+    EXPECT_EQ(client.decompress(client.compress(data)), data);
+    std::filesystem::remove("daemon_missing.mtc");
+}
+
+TEST(CompressionDaemonTest, RequestSizeLimit) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 16 * 1024, 2);
+    CompressionDaemon daemon(tc, socketPath("mtc-limit"));
+    daemon.setMaxRequestSize(4000);
+    DaemonClient client(socketPath("mtc-limit"));
+
+    auto archive = tc.compress(sampleData(5000));
+    ASSERT_LT(archive.size(), 4000u);
+    EXPECT_THROW(client.compress(sampleData(5000)), std::runtime_error);
+    EXPECT_THROW(client.decompress(archive), std::runtime_error);
+
+    // an index claiming 4 GiB is turned down before anything is allocated
+    std::vector<uint8_t> claim;
+    ArchiveWriter writer(claim);
+    writer.add(std::span<const uint8_t>(archive).first(Archive::readIndex(archive)[0].compressed_size), 0,
+               uint64_t{4} << 30);
+    writer.finish();
+    daemon.setMaxRequestSize(CompressionDaemon::kDefaultMaxRequestSize);
+    EXPECT_THROW(client.decompress(claim), std::runtime_error);
+
+    EXPECT_EQ(client.decompress(archive), sampleData(5000));
+    EXPECT_THROW(daemon.setMaxRequestSize(0), std::invalid_argument);
+}
+
+TEST(CompressionDaemonTest, IdleConnectionsHoldNoHandler) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 16 * 1024, 2);
+    CompressionDaemon daemon(tc, socketPath("mtc-idle"), 1);
+
+    std::vector<std::unique_ptr<DaemonClient>> idle;
+    for (int i = 0; i < 4; ++i) {
+        idle.push_back(std::make_unique<DaemonClient>(socketPath("mtc-idle")));
+    }
+    DaemonClient client(socketPath("mtc-idle"));
+    EXPECT_EQ(client.decompress(client.compress(sampleData(2000))), sampleData(2000));
+    EXPECT_EQ(idle.back()->decompress(idle.back()->compress(sampleData(300))), sampleData(300));
+}
+
+TEST(CompressionDaemonTest, StalledPipesTimeOut) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 16 * 1024, 2);
+    CompressionDaemon daemon(tc, socketPath("mtc-stalled"), 1);
+    daemon.setRequestTimeout(std::chrono::milliseconds(100));
+    DaemonClient client(socketPath("mtc-stalled"));
+
+    // an input nobody writes to or closes
+    StalledPipe input;
+    EXPECT_THROW(client.compressFile(input.readEnd(), "daemon_stalled.mtc"), std::runtime_error);
+
+    // an output nobody drains
+    StalledPipe output;
+    FileIO::writeFile("daemon_stalled.bin", sampleData(1 << 20));
+    EXPECT_THROW(client.compressFile("daemon_stalled.bin", output.writeEnd()), std::runtime_error);
+
+    // the single handler is free again
+    EXPECT_EQ(client.decompress(client.compress(sampleData(1000))), sampleData(1000));
+    EXPECT_THROW(daemon.setRequestTimeout(std::chrono::milliseconds(0)), std::invalid_argument);
+    std::filesystem::remove("daemon_stalled.bin");
+    std::filesystem::remove("daemon_stalled.mtc");
+}
+
+TEST(CompressionDaemonTest, StopInterruptsStalledRequest) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 16 * 1024, 2);
+    StalledPipe input;
+    bool failed = false;
+    {
+        CompressionDaemon daemon(tc, socketPath("mtc-interrupt"));
+        std::thread request([&]() {
+            DaemonClient client(socketPath("mtc-interrupt"));
+            try {
+                client.compressFile(input.readEnd(), "daemon_interrupt.mtc");
+            }
+            catch (const std::runtime_error&) {
+                failed = true;
+            }
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        daemon.stop();
+        request.join();
+    }
+    EXPECT_TRUE(failed);
+    std::filesystem::remove("daemon_interrupt.mtc");
+}
+
+TEST(CompressionDaemonTest, ConcurrentClients) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 16 * 1024, 2);
+    CompressionDaemon daemon(tc, socketPath("mtc-concurrent"), 3);
+
+    std::vector<std::thread> clients;
+    std::vector<int> ok(6, 0);
+    for (size_t c = 0; c < ok.size(); ++c) {
+        clients.emplace_back([&, c]() {
+            DaemonClient client(socketPath("mtc-concurrent"));
+            bool same = true;
+            for (size_t i = 0; i < 10; ++i) {
+                auto data = sampleData(1000 + c * 20000 + i * 777);
+                same = same && client.decompress(client.compress(data))==data;
+            }
+            ok[c] = same;
+        });
+    }
+    for (auto& client : clients) {
+        client.join();
+    }
+    for (int same : ok) {
+        EXPECT_TRUE(same);
+    }
+    EXPECT_EQ(daemon.requestsServed(), 120u);
+}
+
+TEST(CompressionDaemonTest, ClientStopsDaemon) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 16 * 1024, 2);
+    std::string path = socketPath("mtc-stop");
+    CompressionDaemon daemon(tc, path);
+
+    // an idle connection does not keep the daemon alive
+    DaemonClient idle(path);
+    std::thread waiter([&daemon]() { daemon.wait(); });
+    DaemonClient(path).stopDaemon();
+    waiter.join();
+
+    EXPECT_THROW(idle.compress(sampleData(10)), std::exception);
+}
+
+TEST(CompressionDaemonTest, SecondDaemonOnSameSocketFails) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 16 * 1024, 2);
+    std::string path = socketPath("mtc-twice");
+    CompressionDaemon daemon(tc, path);
+
+    EXPECT_THROW(CompressionDaemon(tc, path), std::runtime_error);
+    DaemonClient client(path);
+    EXPECT_EQ(client.decompress(client.compress(sampleData(100))), sampleData(100));
+}
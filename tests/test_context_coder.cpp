@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+#include "context_coder.h"
+#include "huffman.h"
+#include <random>
+#include <string>
+
+namespace {
+    // rows of a CSV export, the kind of data where the previous byte predicts the next
+    std::vector<uint8_t> csvData(size_t rows) {
+        std::mt19937 rng(11);
+        std::string text = "id,timestamp,status,latency_ms\n";
+        const char* statuses[] = {"OK", "TIMEOUT", "RETRY", "ERROR"};
+        for (size_t i = 0; i < rows; ++i) {
+            text += std::to_string(100000 + i) + ",2024-05-" + std::to_string(10 + rng() % 20) + "T"
+                  + std::to_string(10 + rng() % 14) + ":" + std::to_string(10 + rng() % 50) + "Z,"
+                  + statuses[rng() % 4] + "," + std::to_string(rng() % 900) + "\n";
+        }
+        return std::vector<uint8_t>(text.begin(), text.end());
+    }
+
+    std::vector<uint8_t> roundTrip(ContextCoder& coder, const std::vector<uint8_t>& input, size_t tables) {
+        uint64_t bits = coder.plan(input, tables);
+        std::vector<uint8_t> out((bits + 7) / 8);
+        uint8_t padding = 0;
+        size_t written = coder.encode(input, out, padding);
+        EXPECT_EQ(written, out.size());
+        EXPECT_EQ(written * 8 - padding, bits);
+
+        ContextCoder decoder;
+        return decoder.decode(out, padding);
+    }
+}
+
+TEST(ContextCoderTest, RoundTrip) {
+    ContextCoder coder;
+    for (size_t tables : {1, 2, 8, 16}) {
+        auto input = csvData(500);
+        EXPECT_EQ(roundTrip(coder, input, tables), input) << tables << " tables";
+    }
+}
+
+TEST(ContextCoderTest, SingleSymbolAndTinyInputs) {
+    ContextCoder coder;
+    EXPECT_EQ(roundTrip(coder, std::vector<uint8_t>(1000, 'z'), 4), std::vector<uint8_t>(1000, 'z'));
+    EXPECT_EQ(roundTrip(coder, {'a'}, 4), std::vector<uint8_t>{'a'});
+    EXPECT_EQ(roundTrip(coder, {'a', 'b'}, 4), (std::vector<uint8_t>{'a', 'b'}));
+}
+
+TEST(ContextCoderTest, SkewedHistogramStaysWithinMaxCodeLength) {
+    // fibonacci counts push plain huffman codes far past kMaxCodeLength
+    std::vector<uint8_t> input;
+    uint32_t a = 1, b = 1;
+    for (int symbol = 0; symbol < 25; ++symbol) {
+        input.insert(input.end(), a, static_cast<uint8_t>(symbol));
+        uint32_t next = a + b;
+        a = b;
+        b = next;
+    }
+    std::shuffle(input.begin(), input.end(), std::mt19937(3));
+
+    ContextCoder coder;
+    EXPECT_EQ(roundTrip(coder, input, 1), input);
+}
+
+TEST(ContextCoderTest, DecodeIntoBuffer) {
+    ContextCoder coder;
+    auto input = csvData(100);
+    std::vector<uint8_t> out((coder.plan(input, 8) + 7) / 8);
+    uint8_t padding = 0;
+    coder.encode(input, out, padding);
+
+    std::vector<uint8_t> decoded(input.size());
+    EXPECT_EQ(coder.decode(out, padding, decoded), input.size());
+    EXPECT_EQ(decoded, input);
+
+    std::vector<uint8_t> small(input.size() - 1);
+    EXPECT_THROW(coder.decode(out, padding, small), std::runtime_error);
+}
+
+TEST(ContextCoderTest, EncodeReportsShortBuffer) {
+    ContextCoder coder;
+    auto input = csvData(100);
+    std::vector<uint8_t> out((coder.plan(input, 8) + 7) / 8 - 1);
+    uint8_t padding = 0;
+    EXPECT_EQ(coder.encode(input, out, padding), 0u);
+}
+
+TEST(ContextCoderTest, CorruptHeaderThrows) {
+    ContextCoder coder;
+    EXPECT_THROW(coder.decode(std::vector<uint8_t>{}, 0), std::runtime_error);
+    EXPECT_THROW(coder.decode(std::vector<uint8_t>{0}, 0), std::runtime_error);
+    EXPECT_THROW(coder.decode(std::vector<uint8_t>{17}, 0), std::runtime_error);
+
+    // one table in which all 256 symbols claim a 1 bit code
+    std::vector<uint8_t> overfull = {1};
+    overfull.insert(overfull.end(), 32, 0xFF);
+    overfull.insert(overfull.end(), 128, 0x11);
+    EXPECT_THROW(coder.decode(overfull, 0), std::runtime_error);
+}
+
+TEST(ContextCoderTest, HuffmanPicksContextTablesForCsv) {
+    auto input = csvData(2000);
+
+    Huffman order0;
+    auto plain = order0.compress(input);
+
+    Huffman order1;
+    order1.setContextTables(8);
+    auto contextual = order1.compress(input);
+    EXPECT_EQ(contextual.bits[0], Huffman::ContextTables);
+    EXPECT_LT(contextual.bits.size(), plain.bits.size() * 9 / 10);
+    EXPECT_LE(contextual.bits.size(), order1.compressBound(input.size()));
+
+    // any instance decodes it, the setting only affects compression
+    Huffman decoder;
+    EXPECT_EQ(decoder.decompress(contextual), input);
+    std::vector<uint8_t> out(input.size());
+    EXPECT_EQ(decoder.decompress(contextual.bits, contextual.padding, out), input.size());
+    EXPECT_EQ(out, input);
+
+    EXPECT_EQ(order1.clone()->compress(input).bits, contextual.bits);
+}
+
+TEST(ContextCoderTest, HuffmanNeverLargerWithContextTables) {
+    // independent bytes: previous-byte tables have nothing to exploit
+    std::mt19937 rng(1);
+    std::vector<uint8_t> input(20000);
+    for (auto& byte : input) {
+        byte = static_cast<uint8_t>('a' + rng() % 16);
+    }
+
+    Huffman plain;
+    Huffman h;
+    h.setContextTables(16);
+    auto encoded = h.compress(input);
+    EXPECT_LE(encoded.bits.size(), plain.compress(input).bits.size());
+    EXPECT_EQ(h.decompress(encoded), input);
+
+    EXPECT_THROW(h.setContextTables(0), std::invalid_argument);
+    EXPECT_THROW(h.setContextTables(17), std::invalid_argument);
+}
@@ -310,4 +310,121 @@ TEST(HuffmanTest, RandomDataRoundTripFullTest) {
     auto decoded = h.decompress(encoded);
 
     ASSERT_EQ(decoded, input);
-}
\ No newline at end of file
+}
+
+TEST(HuffmanTest, CompressedChunkCarriesItsTree) {
+    Huffman encoder;
+    std::vector<uint8_t> input = {'a','b','r','a','c','a','d','a','b','r','a'};
+
+    auto encoded = encoder.compress(input);
+    ASSERT_EQ(encoded.bits[0], Huffman::CustomTable);
+
+    // a fresh instance decodes without the encoder's state
+    Huffman decoder;
+    ASSERT_EQ(decoder.decompress(encoded), input);
+}
+
+TEST(HuffmanTest, EmptyChunkRoundTrip) {
+    Huffman h;
+    std::vector<uint8_t> input;
+
+    auto encoded = h.compress(input);
+    ASSERT_EQ(h.decompress(encoded), input);
+}
+
+TEST(HuffmanTest, ByteAlignedDataHasNoPadding) {
+    Huffman h;
+    std::vector<uint8_t> input = {'a','b','a','b','a','b','a','b'};
+
+    h.buildFrequencyTable(input);
+    h.buildHuffmanTree();
+    std::string start;
+    h.generateCodes(h.getRoot(), start);
+
+    auto encoded = h.encodeData(input);
+    ASSERT_EQ(encoded.bits.size(), 1);
+    ASSERT_EQ(encoded.padding, 0);
+    ASSERT_EQ(h.decodeData(encoded), input);
+}
+
+TEST(HuffmanTest, CompressIntoPreallocatedBuffer) {
+    Huffman h;
+    std::vector<uint8_t> input(5000);
+    for (size_t i = 0; i < input.size(); ++i) {
+        input[i] = static_cast<uint8_t>(rand() % 256);
+    }
+
+    std::vector<uint8_t> out(h.compressBound(input.size()));
+    uint8_t padding = 0;
+    size_t written = h.compress(input, out, padding);
+    ASSERT_LE(written, out.size());
+
+    Compressor::EncodedData encoded;
+    encoded.bits.assign(out.begin(), out.begin() + written);
+    encoded.padding = padding;
+    ASSERT_EQ(h.decompress(encoded), input);
+}
+
+TEST(HuffmanTest, CompressRejectsBufferBelowBound) {
+    Huffman h;
+    std::vector<uint8_t> input(100, 'a');
+    std::vector<uint8_t> out(h.compressBound(input.size()) - 1);
+    uint8_t padding = 0;
+
+    EXPECT_THROW(h.compress(input, out, padding), std::invalid_argument);
+}
+
+TEST(HuffmanTest, DecompressIntoPreallocatedBuffer) {
+    Huffman h;
+    std::string text = "decode straight into the caller's buffer";
+    std::vector<uint8_t> input(text.begin(), text.end());
+    auto encoded = h.compress(input);
+
+    Huffman decoder;
+    std::vector<uint8_t> out(input.size());
+    EXPECT_EQ(decoder.decompress(encoded.bits, encoded.padding, out), input.size());
+    EXPECT_EQ(out, input);
+
+    std::vector<uint8_t> too_small(input.size() - 1);
+    EXPECT_THROW(decoder.decompress(encoded.bits, encoded.padding, too_small), std::runtime_error);
+}
+
+TEST(HuffmanTest, RepeatTableReusesPreviousCodes) {
+    Huffman encoder;
+    encoder.setTableReuse(0.05);
+    std::string text = "the same alphabet in every chunk of the stream";
+    std::vector<uint8_t> first(text.begin(), text.end());
+    std::vector<uint8_t> second(first.rbegin(), first.rend());
+
+    auto a = encoder.compress(first);
+    auto b = encoder.compress(second);
+    ASSERT_EQ(a.bits[0], Huffman::CustomTable);
+    ASSERT_EQ(b.bits[0], Huffman::RepeatTable);
+    EXPECT_LT(b.bits.size(), a.bits.size());
+    EXPECT_TRUE(encoder.standsAlone(a.bits));
+    EXPECT_FALSE(encoder.standsAlone(b.bits));
+
+    // the decoder keeps the stream's table between chunks
+    Huffman decoder;
+    EXPECT_EQ(decoder.decompress(a), first);
+    EXPECT_EQ(decoder.decompress(b), second);
+
+    decoder.resetStream();
+    EXPECT_THROW(decoder.decompress(b), std::runtime_error);
+    Huffman fresh;
+    EXPECT_THROW(fresh.decompress(b), std::runtime_error);
+}
+
+TEST(HuffmanTest, RepeatTableNeedsEveryByteCovered) {
+    Huffman h;
+    h.setTableReuse(1.0);
+    std::vector<uint8_t> first = {'a','a','a','b'};
+    std::vector<uint8_t> second = {'a','b','z'};
+
+    h.compress(first);
+    EXPECT_EQ(h.compress(second).bits[0], Huffman::CustomTable);
+
+    h.resetStream();
+    EXPECT_EQ(h.compress(second).bits[0], Huffman::CustomTable);
+    EXPECT_THROW(h.setTableReuse(-0.5), std::invalid_argument);
+}
@@ -0,0 +1,153 @@
+#include <gtest/gtest.h>
+#include "huffman_dictionary.h"
+#include <filesystem>
+
+namespace {
+    std::vector<uint8_t> toBytes(const std::string& s) {
+        return std::vector<uint8_t>(s.begin(), s.end());
+    }
+
+    std::shared_ptr<HuffmanDictionary> trainJsonDictionary() {
+        std::vector<std::vector<uint8_t>> samples = {
+            toBytes("{\"id\":1,\"name\":\"alpha\",\"tags\":[\"a\",\"b\"]}"),
+            toBytes("{\"id\":2,\"name\":\"beta\",\"tags\":[]}"),
+            toBytes("{\"id\":3,\"name\":\"gamma\",\"tags\":[\"c\"]}"),
+        };
+        return HuffmanDictionary::train(7, "json-rpc", samples);
+    }
+
+    // serialized tree over every byte: the first spine bytes hang off a chain, one per level,
+    // the rest form a balanced subtree below it
+    void caterpillarTree(std::vector<uint8_t>& out, size_t first, size_t end, size_t spine) {
+        out.push_back(0);
+        if (spine > 0) {
+            out.push_back(1);
+            out.push_back(static_cast<uint8_t>(first));
+            caterpillarTree(out, first + 1, end, spine - 1);
+            return;
+        }
+        size_t mid = first + (end - first) / 2;
+        for (auto [lo, hi] : {std::pair{first, mid}, std::pair{mid, end}}) {
+            if (hi - lo==1) {
+                out.push_back(1);
+                out.push_back(static_cast<uint8_t>(lo));
+            }
+            else {
+                caterpillarTree(out, lo, hi, 0);
+            }
+        }
+    }
+}
+
+TEST(HuffmanDictionaryTest, TrainedTableCoversEveryByte) {
+    auto dict = trainJsonDictionary();
+
+    EXPECT_EQ(dict->getId(), 7);
+    EXPECT_EQ(dict->getName(), "json-rpc");
+
+    auto codes = dict->getCoder().encodeData(std::vector<uint8_t>{0x00, 0xFF, '{'});
+    EXPECT_FALSE(codes.bits.empty());
+}
+
+TEST(HuffmanDictionaryTest, SerializeRoundTrip) {
+    auto dict = trainJsonDictionary();
+    auto copy = HuffmanDictionary::deserialize(dict->serialize());
+
+    EXPECT_EQ(copy->getId(), dict->getId());
+    EXPECT_EQ(copy->getName(), dict->getName());
+    EXPECT_EQ(copy->serialize(), dict->serialize());
+}
+
+TEST(HuffmanDictionaryTest, SaveAndLoadFile) {
+    const std::string fileName = "dictionary_test.mtcd";
+    auto dict = trainJsonDictionary();
+
+    dict->save(fileName);
+    auto loaded = HuffmanDictionary::load(fileName);
+
+    EXPECT_EQ(loaded->serialize(), dict->serialize());
+
+    std::filesystem::remove(fileName);
+}
+
+TEST(HuffmanDictionaryTest, DeserializeRejectsGarbage) {
+    EXPECT_THROW(HuffmanDictionary::deserialize({1, 2, 3, 4, 5, 6}), std::runtime_error);
+}
+
+TEST(HuffmanDictionaryTest, LongNameThrows) {
+    std::vector<std::vector<uint8_t>> samples = {toBytes("abc")};
+    auto dict = HuffmanDictionary::train(1, std::string(HuffmanDictionary::kMaxNameLength, 'n'), samples);
+    EXPECT_EQ(HuffmanDictionary::deserialize(dict->serialize())->getName(), dict->getName());
+
+    EXPECT_THROW(HuffmanDictionary::train(1, std::string(HuffmanDictionary::kMaxNameLength + 1, 'n'), samples),
+                 std::invalid_argument);
+}
+
+TEST(HuffmanDictionaryTest, TreeDeeperThanCodesThrows) {
+    // 56 spine bytes put the other 200 eight levels further down, 64 bits at most
+    std::vector<uint8_t> deepest;
+    caterpillarTree(deepest, 0, 256, 56);
+    HuffmanDictionary dict(1, "deep", deepest);
+    std::vector<uint8_t> data(1000);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<uint8_t>(255 - i % 7);
+    }
+    EXPECT_EQ(dict.getCoder().decodeData(dict.getCoder().encodeData(data)), data);
+
+    std::vector<uint8_t> too_deep;
+    caterpillarTree(too_deep, 0, 256, 57);
+    EXPECT_THROW(HuffmanDictionary(1, "deep", too_deep), std::invalid_argument);
+}
+
+TEST(HuffmanDictionaryTest, SmallMessageUsesStaticTable) {
+    auto dict = trainJsonDictionary();
+    Huffman h;
+    h.addDictionary(dict);
+
+    auto input = toBytes("{\"id\":42,\"name\":\"delta\",\"tags\":[\"d\"]}");
+    auto encoded = h.compress(input);
+
+    ASSERT_GE(encoded.bits.size(), 2u);
+    EXPECT_EQ(encoded.bits[0], Huffman::StaticTable);
+    EXPECT_EQ(encoded.bits[1], 7);
+
+    // the same message with its own tree is larger
+    Huffman plain;
+    EXPECT_LT(encoded.bits.size(), plain.compress(input).bits.size());
+
+    Huffman decoder;
+    decoder.addDictionary(dict);
+    EXPECT_EQ(decoder.decompress(encoded), input);
+}
+
+TEST(HuffmanDictionaryTest, SkewedChunkUsesCustomTable) {
+    auto dict = trainJsonDictionary();
+    Huffman h;
+    h.addDictionary(dict);
+
+    // a large chunk of bytes the corpus never saw is cheaper with its own tree
+    std::vector<uint8_t> input(4096, 0x80);
+    for (size_t i=0; i<input.size(); i+=3) {
+        input[i] = 0x81;
+    }
+    auto encoded = h.compress(input);
+
+    EXPECT_EQ(encoded.bits[0], Huffman::CustomTable);
+    EXPECT_EQ(h.decompress(encoded), input);
+}
+
+TEST(HuffmanDictionaryTest, UnknownDictionaryIdThrows) {
+    Huffman h;
+    h.addDictionary(trainJsonDictionary());
+    auto encoded = h.compress(toBytes("{\"id\":5}"));
+    ASSERT_EQ(encoded.bits[0], Huffman::StaticTable);
+
+    Huffman decoder;
+    EXPECT_THROW(decoder.decompress(encoded), std::runtime_error);
+}
+
+TEST(HuffmanDictionaryTest, DuplicateIdThrows) {
+    Huffman h;
+    h.addDictionary(trainJsonDictionary());
+    EXPECT_THROW(h.addDictionary(trainJsonDictionary()), std::invalid_argument);
+}
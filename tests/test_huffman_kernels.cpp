@@ -0,0 +1,185 @@
+#include <gtest/gtest.h>
+#include "huffman.h"
+#include "huffman_kernels.h"
+#include <random>
+
+namespace {
+    using Isa = HuffmanKernels::Isa;
+
+    std::vector<Isa> supportedIsas() {
+        std::vector<Isa> isas;
+        for (Isa isa : {Isa::Scalar, Isa::Bmi2}) {
+            if (HuffmanKernels::supported(isa)) {
+                isas.push_back(isa);
+            }
+        }
+        return isas;
+    }
+
+    // byte i < depth gets i ones and a zero as its code, byte depth gets depth ones
+    std::vector<uint8_t> caterpillarTree(size_t depth) {
+        std::vector<uint8_t> tree;
+        for (size_t i = 0; i < depth; ++i) {
+            tree.insert(tree.end(), {0, 1, static_cast<uint8_t>(i)});
+        }
+        tree.insert(tree.end(), {1, static_cast<uint8_t>(depth)});
+        return tree;
+    }
+
+    std::vector<uint8_t> skewedData(size_t size) {
+        std::mt19937 rng(11);
+        std::geometric_distribution<int> dist(0.08);
+        std::vector<uint8_t> data(size);
+        for (auto& byte : data) {
+            byte = static_cast<uint8_t>(std::min(dist(rng), 255));
+        }
+        return data;
+    }
+
+    struct Coder {
+        Huffman huffman;
+        std::array<HuffmanCode, 256> codes{};
+        unsigned int max_length = 0;
+        HuffmanDecodeTable table;
+
+        explicit Coder(const std::vector<uint8_t>& tree) {
+            huffman.loadTree(tree);
+            for (const auto& [byte, code] : huffman.getHuffmanCodes()) {
+                for (char bit : code) {
+                    codes[byte].bits = (codes[byte].bits << 1) | (bit=='1');
+                }
+                codes[byte].length = static_cast<uint8_t>(code.size());
+                max_length = std::max<unsigned int>(max_length, code.size());
+            }
+            table = huffman.getDecodeTable();
+        }
+
+        std::vector<uint8_t> encode(const std::vector<uint8_t>& data, unsigned int length, Isa isa, uint8_t& padding) const {
+            std::vector<uint8_t> out((data.size() * std::max(length, max_length) + 7) / 8);
+            out.resize(HuffmanKernels::encode(data, codes, length, out, padding, isa));
+            return out;
+        }
+    };
+
+    Coder coderFor(const std::vector<uint8_t>& data) {
+        Huffman builder;
+        builder.buildFrequencyTable(data);
+        builder.buildHuffmanTree();
+        std::vector<uint8_t> tree;
+        builder.serializeTree(builder.getRoot(), tree);
+        return Coder(tree);
+    }
+}
+
+TEST(HuffmanKernelsTest, BestIsSupported) {
+    EXPECT_TRUE(HuffmanKernels::supported(Isa::Scalar));
+    EXPECT_TRUE(HuffmanKernels::supported(HuffmanKernels::best()));
+}
+
+TEST(HuffmanKernelsTest, EveryVariantWritesTheSameBits) {
+    auto data = skewedData(20000);
+    Coder coder = coderFor(data);
+    ASSERT_GT(coder.max_length, HuffmanDecodeTable::kTableBits);
+
+    // lengths past 56 take the byte at a time path every variant falls back to
+    uint8_t expected_padding = 0;
+    auto expected = coder.encode(data, 64, Isa::Scalar, expected_padding);
+
+    for (Isa isa : supportedIsas()) {
+        for (unsigned int length : {coder.max_length, 18u, 28u, 56u, 57u}) {
+            uint8_t padding = 0;
+            EXPECT_EQ(coder.encode(data, length, isa, padding), expected) << "length " << length;
+            EXPECT_EQ(padding, expected_padding);
+        }
+
+        std::vector<uint8_t> out(data.size());
+        EXPECT_EQ(HuffmanKernels::decode(expected, expected_padding, coder.table, out, isa), data.size());
+        EXPECT_EQ(out, data);
+    }
+}
+
+TEST(HuffmanKernelsTest, ShortCodesDecodeInOneLookup) {
+    std::vector<uint8_t> data(5000);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = "abcdefgh"[(i * 7 + i / 3) % 8];
+    }
+    Coder coder = coderFor(data);
+    ASSERT_LE(coder.max_length, 8u);
+
+    for (Isa isa : supportedIsas()) {
+        uint8_t padding = 0;
+        auto bits = coder.encode(data, coder.max_length, isa, padding);
+        std::vector<uint8_t> out(data.size());
+        EXPECT_EQ(HuffmanKernels::decode(bits, padding, coder.table, out, isa), data.size());
+        EXPECT_EQ(out, data);
+    }
+}
+
+TEST(HuffmanKernelsTest, DecodeTableOfABuiltTree) {
+    // a built tree puts its leaves first and the root last in the node storage
+    auto data = skewedData(20000);
+    Huffman huffman;
+    huffman.buildFrequencyTable(data);
+    huffman.buildHuffmanTree();
+    std::string path;
+    huffman.generateCodes(huffman.getRoot(), path);
+    auto encoded = huffman.encodeData(data);
+
+    auto table = huffman.getDecodeTable();
+    for (Isa isa : supportedIsas()) {
+        std::vector<uint8_t> out(data.size());
+        EXPECT_EQ(HuffmanKernels::decode(encoded.bits, encoded.padding, table, out, isa), data.size());
+        EXPECT_EQ(out, data);
+    }
+}
+
+TEST(HuffmanKernelsTest, CodesLongerThan56Bits) {
+    Coder coder(caterpillarTree(60));
+    ASSERT_EQ(coder.max_length, 60u);
+
+    std::vector<uint8_t> data;
+    for (int round = 0; round < 20; ++round) {
+        for (uint8_t byte = 0; byte <= 60; ++byte) {
+            data.push_back(byte);
+        }
+    }
+    for (Isa isa : supportedIsas()) {
+        uint8_t padding = 0;
+        auto bits = coder.encode(data, coder.max_length, isa, padding);
+        std::vector<uint8_t> out(data.size());
+        EXPECT_EQ(HuffmanKernels::decode(bits, padding, coder.table, out, isa), data.size());
+        EXPECT_EQ(out, data);
+    }
+}
+
+TEST(HuffmanKernelsTest, PayloadEndingInsideACodeThrows) {
+    Coder coder(caterpillarTree(20));
+    std::vector<uint8_t> data(100, 19);   // 20 bit codes
+
+    uint8_t padding = 0;
+    auto bits = coder.encode(data, coder.max_length, Isa::Scalar, padding);
+    bits.pop_back();
+    std::vector<uint8_t> out(data.size());
+    EXPECT_THROW(HuffmanKernels::decode(bits, 0, coder.table, out), std::runtime_error);
+}
+
+TEST(HuffmanKernelsTest, OutputTooSmallThrows) {
+    auto data = skewedData(1000);
+    Coder coder = coderFor(data);
+
+    uint8_t padding = 0;
+    auto bits = coder.encode(data, coder.max_length, Isa::Scalar, padding);
+    std::vector<uint8_t> out(data.size() - 1);
+    EXPECT_THROW(HuffmanKernels::decode(bits, padding, coder.table, out), std::runtime_error);
+}
+
+TEST(HuffmanKernelsTest, MissingCodeThrows) {
+    Coder coder(caterpillarTree(3));
+    std::vector<uint8_t> data(100, 0);
+    data[50] = 'z';
+
+    for (Isa isa : supportedIsas()) {
+        uint8_t padding = 0;
+        EXPECT_THROW(coder.encode(data, coder.max_length, isa, padding), std::invalid_argument);
+    }
+}
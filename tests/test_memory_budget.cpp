@@ -0,0 +1,75 @@
+#include <gtest/gtest.h>
+#include "memory_budget.h"
+#include <atomic>
+#include <thread>
+
+TEST(MemoryBudgetTest, UnlimitedByDefault) {
+    MemoryBudget budget;
+    EXPECT_TRUE(budget.tryAcquire(1ull << 40));
+    EXPECT_TRUE(budget.tryAcquire(1ull << 40));
+    EXPECT_EQ(budget.usage().in_flight, 2ull << 40);
+}
+
+TEST(MemoryBudgetTest, TryAcquireStopsAtTheLimit) {
+    MemoryBudget budget(100);
+    EXPECT_TRUE(budget.tryAcquire(60));
+    EXPECT_FALSE(budget.tryAcquire(60));
+    EXPECT_TRUE(budget.tryAcquire(40));
+    budget.release(60);
+    EXPECT_TRUE(budget.tryAcquire(50));
+
+    auto usage = budget.usage();
+    EXPECT_EQ(usage.limit, 100u);
+    EXPECT_EQ(usage.in_flight, 90u);
+    EXPECT_EQ(usage.peak, 100u);
+}
+
+TEST(MemoryBudgetTest, OversizedRequestFitsWhenIdle) {
+    MemoryBudget budget(100);
+    EXPECT_TRUE(budget.tryAcquire(500));
+    EXPECT_FALSE(budget.tryAcquire(1));
+    budget.release(500);
+    EXPECT_EQ(budget.usage().in_flight, 0u);
+}
+
+TEST(MemoryBudgetTest, ForceAcquireOvershoots) {
+    MemoryBudget budget(100);
+    budget.forceAcquire(80);
+    budget.forceAcquire(80);
+    EXPECT_EQ(budget.usage().in_flight, 160u);
+    EXPECT_FALSE(budget.tryAcquire(1));
+}
+
+TEST(MemoryBudgetTest, AcquireBlocksUntilRelease) {
+    MemoryBudget budget(100);
+    budget.forceAcquire(100);
+
+    std::atomic<bool> acquired{false};
+    std::thread producer([&]() {
+        budget.acquire(50);
+        acquired = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_FALSE(acquired);
+    budget.release(100);
+    producer.join();
+
+    EXPECT_TRUE(acquired);
+    EXPECT_EQ(budget.usage().waits, 1u);
+    EXPECT_EQ(budget.usage().in_flight, 50u);
+}
+
+TEST(MemoryBudgetTest, RaisingTheLimitWakesProducers) {
+    MemoryBudget budget(100);
+    budget.forceAcquire(100);
+    std::thread producer([&]() { budget.acquire(50); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    budget.setLimit(200);
+    producer.join();
+    EXPECT_EQ(budget.usage().in_flight, 150u);
+}
+
+TEST(MemoryBudgetTest, ZeroLimitThrows) {
+    MemoryBudget budget;
+    EXPECT_THROW(budget.setLimit(0), std::invalid_argument);
+}
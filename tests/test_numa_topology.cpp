@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+#include "numa_topology.h"
+#include <cstdint>
+#include <set>
+#include <thread>
+#include <sched.h>
+
+TEST(NumaTopologyTest, DetectFindsUsableCpus) {
+    auto topology = NumaTopology::detect();
+
+    ASSERT_FALSE(topology.getNodes().empty());
+    for (const auto& node : topology.getNodes()) {
+        EXPECT_FALSE(node.cpus.empty());
+    }
+}
+
+TEST(NumaTopologyTest, WorkersSpreadAcrossNodes) {
+    NumaTopology topology(std::vector<NumaTopology::Node>{{0, {0, 1}}, {1, {2, 3}}});
+
+    auto w0 = topology.placeWorker(0);
+    auto w1 = topology.placeWorker(1);
+    auto w2 = topology.placeWorker(2);
+    auto w3 = topology.placeWorker(3);
+
+    EXPECT_EQ(w0.node, 0);
+    EXPECT_EQ(w1.node, 1);
+    EXPECT_EQ(w2.node, 0);
+    EXPECT_EQ(w3.node, 1);
+
+    std::set<int> cpus = {w0.cpu, w1.cpu, w2.cpu, w3.cpu};
+    EXPECT_EQ(cpus, (std::set<int>{0, 1, 2, 3}));
+}
+
+TEST(NumaTopologyTest, MoreWorkersThanCpusWrapAround) {
+    NumaTopology topology(std::vector<NumaTopology::Node>{{0, {5}}});
+
+    EXPECT_EQ(topology.placeWorker(0).cpu, 5);
+    EXPECT_EQ(topology.placeWorker(3).cpu, 5);
+}
+
+TEST(NumaTopologyTest, EmptyTopologyThrows) {
+    EXPECT_THROW(NumaTopology(std::vector<NumaTopology::Node>{}), std::invalid_argument);
+}
+
+TEST(NumaTopologyTest, PinToAllowedCpu) {
+    auto topology = NumaTopology::detect();
+    int cpu = topology.getNodes()[0].cpus[0];
+
+    // pin a thread of its own, later tests must keep the main thread's affinity
+    bool pinned = false;
+    int running_on = -1;
+    std::thread([&]() {
+        pinned = NumaTopology::pinCurrentThread(cpu);
+        running_on = sched_getcpu();
+    }).join();
+    EXPECT_TRUE(pinned);
+    EXPECT_EQ(running_on, cpu);
+}
+
+TEST(NumaTopologyTest, BindKeepsTouchedMemory) {
+    auto topology = NumaTopology::detect();
+    // unaligned and already written, as a recycled heap buffer would be
+    std::vector<uint8_t> memory(5 * 4096 + 123);
+    for (size_t i = 0; i < memory.size(); ++i) {
+        memory[i] = static_cast<uint8_t>(i * 7);
+    }
+
+    NumaTopology::bindMemory(memory.data() + 1, memory.size() - 1, topology.getNodes()[0].id);
+    NumaTopology::bindMemory(memory.data() + 1, 10, topology.getNodes()[0].id);
+    for (size_t i = 0; i < memory.size(); ++i) {
+        ASSERT_EQ(memory[i], static_cast<uint8_t>(i * 7));
+    }
+}
@@ -0,0 +1,45 @@
+#include <gtest/gtest.h>
+#include "rate_limiter.h"
+#include <thread>
+
+namespace {
+    double secondsFor(RateLimiter& limiter, size_t requests, size_t bytes) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < requests; ++i) {
+            limiter.acquire(bytes);
+        }
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+TEST(RateLimiterTest, UnlimitedNeverWaits) {
+    RateLimiter limiter;
+    EXPECT_LT(secondsFor(limiter, 1000, 1 << 30), 0.1);
+    EXPECT_EQ(limiter.getRate(), RateLimiter::kUnlimited);
+}
+
+TEST(RateLimiterTest, PacesToTheRate) {
+    RateLimiter limiter(1'000'000);
+    // the first request overdraws the empty bucket, the next four each pay off 50ms of debt
+    double seconds = secondsFor(limiter, 5, 50'000);
+    EXPECT_GE(seconds, 0.19);
+    EXPECT_LT(seconds, 1.0);
+    EXPECT_GT(limiter.getWaited().count(), 0);
+}
+
+TEST(RateLimiterTest, OversizedRequestGoesThroughInDebt) {
+    RateLimiter limiter(1'000'000);
+    EXPECT_LT(secondsFor(limiter, 1, 10'000'000), 0.1);
+}
+
+TEST(RateLimiterTest, LiftingTheRateReleasesWaiters) {
+    RateLimiter limiter(1000);
+    limiter.acquire(1'000'000);   // 1000 seconds of debt
+
+    std::thread waiter([&limiter]() { limiter.acquire(1); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    auto start = std::chrono::steady_clock::now();
+    limiter.setRate(RateLimiter::kUnlimited);
+    waiter.join();
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(1));
+}
@@ -0,0 +1,496 @@
+#include <gtest/gtest.h>
+#include "threaded_compressor.h"
+#include "huffman_dictionary.h"
+#include <algorithm>
+#include <filesystem>
+#include <sstream>
+
+namespace {
+    std::vector<uint8_t> sampleData(size_t size) {
+        std::vector<uint8_t> data(size);
+        for (size_t i = 0; i < size; ++i) {
+            data[i] = static_cast<uint8_t>("the quick brown fox jumps over the lazy dog"[i % 43] + (i / 997) % 3);
+        }
+        return data;
+    }
+}
+
+TEST(ThreadedCompressorTest, CompressFileRoundTrip) {
+    const std::string fileName = "threaded_roundtrip.bin";
+    auto data = sampleData(100'000);
+    FileIO::writeFile(fileName, data);
+
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 4096, 4);
+    auto compressed = tc.compressFile(fileName);
+
+    EXPECT_EQ(compressed.size(), 25u);
+    EXPECT_EQ(tc.decompressFile(compressed), data);
+
+    std::filesystem::remove(fileName);
+}
+
+TEST(ThreadedCompressorTest, EmptyFileProducesNoChunks) {
+    const std::string fileName = "threaded_empty.bin";
+    FileIO::writeFile(fileName, {});
+
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 1024, 2);
+    EXPECT_TRUE(tc.compressFile(fileName).empty());
+
+    std::filesystem::remove(fileName);
+}
+
+TEST(ThreadedCompressorTest, AutoModeRoundTrip) {
+    const std::string fileName = "threaded_auto.bin";
+    auto data = sampleData(600'000);
+    FileIO::writeFile(fileName, data);
+
+    std::ostringstream log;
+    ThreadedCompressor tc(std::make_unique<Huffman>(), ThreadedCompressor::kAuto, ThreadedCompressor::kAuto);
+    tc.setLog(&log);
+    auto compressed = tc.compressFile(fileName);
+
+    auto metrics = tc.getMetrics();
+    EXPECT_GE(metrics.chunk_size, AutoTuner::kMinChunkSize);
+    EXPECT_GE(metrics.thread_count, 1u);
+    EXPECT_NE(log.str().find("auto-tune: chunk_size="), std::string::npos);
+    EXPECT_EQ(tc.decompressFile(compressed), data);
+
+    std::filesystem::remove(fileName);
+}
+
+TEST(ThreadedCompressorTest, AutoModeStreamRoundTrip) {
+    auto data = sampleData(300'000);
+    std::stringstream input(std::string(data.begin(), data.end()));
+
+    ThreadedCompressor tc(std::make_unique<Huffman>(), ThreadedCompressor::kAuto, 2);
+    tc.setLog(nullptr);
+    std::vector<Compressor::EncodedData> chunks;
+    tc.compressStream(input, [&](const Compressor::EncodedData& chunk) {
+        chunks.push_back(chunk);
+    });
+
+    EXPECT_EQ(tc.decompressFile(chunks), data);
+}
+
+TEST(ThreadedCompressorTest, StreamMatchesFileCompression) {
+    auto data = sampleData(50'000);
+    std::stringstream input(std::string(data.begin(), data.end()));
+
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 4096, 3);
+    std::vector<Compressor::EncodedData> chunks;
+    tc.compressStream(input, [&](const Compressor::EncodedData& chunk) {
+        chunks.push_back(chunk);
+    });
+
+    EXPECT_EQ(chunks.size(), 13u);
+    EXPECT_EQ(tc.decompressFile(chunks), data);
+}
+
+TEST(ThreadedCompressorTest, StreamSteadyStateDoesNotAllocate) {
+    const size_t chunkSize = 4096;
+    const size_t threads = 2;
+    ThreadedCompressor tc(std::make_unique<Huffman>(), chunkSize, threads);
+
+    auto data = sampleData(400 * chunkSize);
+    std::stringstream input(std::string(data.begin(), data.end()));
+    tc.compressStream(input, [](const Compressor::EncodedData&) {});
+
+    // at most 2 * threads chunks are in flight, each holding one input and one output buffer
+    // taken from a pool, so allocations stop growing no matter how long the stream is
+    const size_t window = 2 * threads;
+    auto metrics = tc.getMetrics();
+    EXPECT_EQ(metrics.chunks_compressed, 400u);
+    EXPECT_LE(metrics.buffer_allocations, window + threads * window);
+}
+
+TEST(ThreadedCompressorTest, NumaPinnedRoundTrip) {
+    auto data = sampleData(200'000);
+    std::stringstream input(std::string(data.begin(), data.end()));
+
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 8192, 4, ThreadedCompressor::Placement::NumaPinned);
+    std::vector<Compressor::EncodedData> chunks;
+    tc.compressStream(input, [&](const Compressor::EncodedData& chunk) {
+        chunks.push_back(chunk);
+    });
+
+    EXPECT_EQ(chunks.size(), 25u);
+    EXPECT_EQ(tc.decompressFile(chunks), data);
+}
+
+TEST(ThreadedCompressorTest, SmallBufferRunsInline) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 4096, 2);
+    auto data = sampleData(1024);
+
+    auto archive = tc.compress(data);
+    EXPECT_LT(archive.size(), data.size());
+    EXPECT_EQ(tc.decompress(archive), data);
+
+    auto metrics = tc.getMetrics();
+    EXPECT_EQ(metrics.inline_calls, 2u);
+    EXPECT_EQ(metrics.chunks_compressed, 0u);
+}
+
+TEST(ThreadedCompressorTest, LargeBufferUsesPool) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 16 * 1024, 3);
+    auto data = sampleData(ThreadedCompressor::kInlineThreshold * 4);
+
+    auto archive = tc.compress(data);
+    EXPECT_EQ(Archive::readIndex(archive).size(), 16u);
+    EXPECT_EQ(tc.decompress(archive), data);
+
+    auto metrics = tc.getMetrics();
+    EXPECT_EQ(metrics.inline_calls, 0u);
+    EXPECT_EQ(metrics.chunks_compressed, 16u);
+    EXPECT_EQ(metrics.chunks_decompressed, 16u);
+}
+
+TEST(ThreadedCompressorTest, EmptyBufferRoundTrip) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 4096, 2);
+    std::vector<uint8_t> empty;
+
+    auto archive = tc.compress(empty);
+    EXPECT_TRUE(tc.decompress(archive).empty());
+}
+
+TEST(ThreadedCompressorTest, BatchOfSmallBuffers) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 4096, 4);
+
+    std::vector<std::vector<uint8_t>> buffers;
+    for (size_t i = 0; i < 2000; ++i) {
+        buffers.push_back(sampleData(200 + i % 900));
+    }
+    std::vector<std::span<const uint8_t>> inputs(buffers.begin(), buffers.end());
+
+    auto archives = tc.compressBatch(inputs);
+    ASSERT_EQ(archives.size(), buffers.size());
+
+    std::vector<std::span<const uint8_t>> views(archives.begin(), archives.end());
+    auto restored = tc.decompressBatch(views);
+    ASSERT_EQ(restored.size(), buffers.size());
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        ASSERT_EQ(restored[i], buffers[i]) << "buffer " << i;
+        // each archive stands alone
+        ASSERT_EQ(tc.decompress(archives[i]), buffers[i]);
+    }
+}
+
+TEST(ThreadedCompressorTest, CorruptArchiveThrows) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 4096, 2);
+    auto archive = tc.compress(sampleData(1000));
+    archive[archive.size() - 1] ^= 0xFF;
+
+    EXPECT_THROW(tc.decompress(archive), std::runtime_error);
+}
+
+TEST(ThreadedCompressorTest, WrappingIndexThrows) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 4096, 2);
+    auto chunk = tc.compress(sampleData(16));
+    auto bits = std::span<const uint8_t>(chunk).first(Archive::readIndex(chunk)[0].compressed_size);
+
+    // original sizes adding up to 16 modulo 2^64 must not size the output
+    std::vector<uint8_t> archive;
+    ArchiveWriter writer(archive);
+    writer.add(bits, 0, size_t{1} << 63);
+    writer.add(bits, 0, size_t{1} << 63);
+    writer.add(bits, 0, 16);
+    writer.finish();
+
+    EXPECT_THROW(tc.decompress(archive), std::runtime_error);
+    EXPECT_THROW(tc.decompressAsync(archive).get(), std::runtime_error);
+    EXPECT_THROW(tc.decompressBatch({archive}), std::runtime_error);
+}
+
+TEST(ThreadedCompressorTest, ForgedOriginalSizeThrows) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 4096, 2);
+    auto chunk = tc.compress(sampleData(16));
+    auto entry = Archive::readIndex(chunk)[0];
+    auto bits = std::span<const uint8_t>(chunk).first(entry.compressed_size);
+
+    // a few payload bytes cannot decode to gigabytes, nothing of that size gets allocated
+    std::vector<uint8_t> archive;
+    ArchiveWriter writer(archive);
+    writer.add(bits, entry.padding, size_t{1} << 34);
+    writer.finish();
+
+    EXPECT_THROW(tc.decompress(archive), std::runtime_error);
+    EXPECT_THROW(tc.decompressAsync(archive).get(), std::runtime_error);
+    EXPECT_THROW(tc.decompressBatch({archive}), std::runtime_error);
+}
+
+TEST(ThreadedCompressorTest, MaxOutputSize) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 4096, 2);
+    auto data = sampleData(ThreadedCompressor::kInlineThreshold * 2);
+    auto archive = tc.compress(data);
+
+    auto small = tc.compress(sampleData(100));
+
+    tc.setMaxOutputSize(data.size() - 1);
+    EXPECT_THROW(tc.decompress(archive), std::length_error);
+    EXPECT_THROW(tc.decompressAsync(archive).get(), std::length_error);
+    EXPECT_EQ(tc.decompress(small), sampleData(100));
+
+    tc.setMaxOutputSize(99);
+    EXPECT_THROW(tc.decompress(small), std::length_error);
+    EXPECT_THROW(tc.decompressBatch({small}), std::length_error);
+
+    tc.setMaxOutputSize(data.size());
+    EXPECT_EQ(tc.decompress(archive), data);
+}
+
+TEST(ThreadedCompressorTest, AppendKeepsExistingChunks) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 4096, 3);
+    auto first = sampleData(20'000);
+    auto second = sampleData(ThreadedCompressor::kInlineThreshold * 2);
+
+    auto archive = tc.compress(first);
+    auto payload_end = Archive::readFooter(archive);
+    std::vector<uint8_t> payloads(archive.begin(), archive.begin() + payload_end);
+
+    tc.append(archive, second);
+    tc.append(archive, std::vector<uint8_t>{});
+
+    // the old payload bytes are untouched, new chunks follow them
+    EXPECT_TRUE(std::equal(payloads.begin(), payloads.end(), archive.begin()));
+    EXPECT_EQ(Archive::readIndex(archive).size(), 5u + 32u);
+
+    auto expected = first;
+    expected.insert(expected.end(), second.begin(), second.end());
+    EXPECT_EQ(tc.decompress(archive), expected);
+}
+
+TEST(ThreadedCompressorTest, AppendToCorruptArchiveLeavesItAlone) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 4096, 2);
+    std::vector<uint8_t> garbage = {1, 2, 3, 4};
+
+    EXPECT_THROW(tc.append(garbage, sampleData(100)), std::runtime_error);
+    EXPECT_EQ(garbage.size(), 4u);
+}
+
+TEST(ThreadedCompressorTest, AppendFileCreatesAndExtends) {
+    const std::string fileName = "threaded_append.mtc";
+    std::filesystem::remove(fileName);
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 4096, 2);
+
+    std::vector<uint8_t> expected;
+    for (size_t i = 0; i < 5; ++i) {
+        auto rotation = sampleData(3000 + i * 1000);
+        tc.appendFile(fileName, rotation);
+        expected.insert(expected.end(), rotation.begin(), rotation.end());
+    }
+
+    auto archive = FileIO::readFile(fileName);
+    EXPECT_EQ(std::filesystem::file_size(fileName), archive.size());
+    EXPECT_EQ(tc.decompress(archive), expected);
+
+    std::filesystem::remove(fileName);
+}
+
+TEST(ThreadedCompressorTest, TableReuseRoundTrip) {
+    auto reuse = std::make_unique<Huffman>();
+    reuse->setTableReuse(0.1);
+    ThreadedCompressor tc(std::move(reuse), 4096, 2);
+    ThreadedCompressor plain(std::make_unique<Huffman>(), 4096, 2);
+    auto data = sampleData(100'000);
+
+    auto archive = tc.compress(data);
+    EXPECT_LT(archive.size(), plain.compress(data).size());
+    EXPECT_EQ(tc.decompress(archive), data);
+    EXPECT_EQ(tc.decompressAsync(archive).get(), data);
+
+    auto entries = Archive::readIndex(archive);
+    size_t repeats = 0;
+    for (const auto& entry : entries) {
+        repeats += archive[entry.offset]==Huffman::RepeatTable;
+    }
+    EXPECT_GT(repeats, 0u);
+}
+
+TEST(ThreadedCompressorTest, TableReuseAcrossDictionaryChunks) {
+    // text chunks match the dictionary, digit chunks need a table of their own and reuse it
+    auto text = sampleData(4096);
+    std::vector<uint8_t> digits(4096);
+    for (size_t i = 0; i < digits.size(); ++i) {
+        digits[i] = static_cast<uint8_t>('0' + (i * i / 7) % 10);
+    }
+    std::vector<uint8_t> data;
+    for (size_t i = 0; i < 8; ++i) {
+        for (const auto* chunk : {&digits, &text, &digits}) {
+            data.insert(data.end(), chunk->begin(), chunk->end());
+        }
+    }
+    ASSERT_GT(data.size(), ThreadedCompressor::kInlineThreshold);
+
+    auto huffman = std::make_unique<Huffman>();
+    huffman->addDictionary(HuffmanDictionary::train(1, "text", {text}));
+    huffman->setTableReuse(0.05);
+    ThreadedCompressor tc(std::move(huffman), 4096, 2);
+
+    auto archive = tc.compress(data);
+    std::vector<uint8_t> kinds;
+    for (const auto& entry : Archive::readIndex(archive)) {
+        kinds.push_back(archive[entry.offset]);
+    }
+    EXPECT_NE(std::find(kinds.begin(), kinds.end(), Huffman::StaticTable), kinds.end());
+    EXPECT_NE(std::find(kinds.begin(), kinds.end(), Huffman::RepeatTable), kinds.end());
+
+    EXPECT_EQ(tc.decompress(archive), data);
+    EXPECT_EQ(tc.decompressAsync(archive).get(), data);
+
+    std::istringstream input(std::string(data.begin(), data.end()));
+    std::vector<Compressor::EncodedData> chunks;
+    tc.compressStream(input, [&](const Compressor::EncodedData& chunk) { chunks.push_back(chunk); });
+    EXPECT_EQ(tc.decompressFile(chunks), data);
+}
+
+TEST(ThreadedCompressorTest, MemoryBudgetBoundsChunksInFlight) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 4096, 4);
+    auto data = sampleData(200'000);
+    auto expected = tc.compress(data);
+    EXPECT_EQ(tc.getMetrics().memory.limit, MemoryBudget::kUnlimited);
+
+    // room for a few chunks with their worst case output
+    const size_t limit = 30'000;
+    tc.setMemoryBudget(limit);
+    EXPECT_EQ(tc.compress(data), expected);
+
+    std::istringstream input(std::string(data.begin(), data.end()));
+    std::vector<Compressor::EncodedData> chunks;
+    tc.compressStream(input, [&](const Compressor::EncodedData& chunk) { chunks.push_back(chunk); });
+    EXPECT_EQ(tc.decompressFile(chunks), data);
+    EXPECT_EQ(tc.compressAsync(data).get(), expected);
+    EXPECT_EQ(tc.decompressAsync(expected).get(), data);
+    EXPECT_EQ(tc.decompress(expected), data);
+
+    auto memory = tc.getMetrics().memory;
+    EXPECT_EQ(memory.limit, limit);
+    EXPECT_EQ(memory.in_flight, 0u);
+    EXPECT_LE(memory.peak, limit);
+    EXPECT_GT(memory.peak, 0u);
+}
+
+TEST(ThreadedCompressorTest, MemoryBudgetSmallerThanARun) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 4096, 2);
+    auto data = sampleData(4 << 20);
+    auto expected = tc.compress(data);
+
+    // a task of 128 chunks would hold about four times the limit
+    const size_t limit = 256 << 10;
+    tc.setMemoryBudget(limit);
+    EXPECT_EQ(tc.compress(data), expected);
+
+    auto memory = tc.getMetrics().memory;
+    EXPECT_EQ(memory.in_flight, 0u);
+    EXPECT_LE(memory.peak, limit);
+    EXPECT_GT(memory.peak, limit / 2);
+}
+
+TEST(ThreadedCompressorTest, MemoryBudgetSharedByConcurrentJobs) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 4096, 2);
+    const size_t limit = 30'000;
+    tc.setMemoryBudget(limit);
+
+    std::vector<std::vector<uint8_t>> inputs;
+    std::vector<AsyncJob> jobs;
+    for (size_t i = 0; i < 4; ++i) {
+        inputs.push_back(sampleData(50'000 + i * 7000));
+        jobs.push_back(tc.compressAsync(inputs.back()));
+    }
+    std::vector<uint8_t> streamed;
+    std::thread reader([&]() {
+        auto data = sampleData(120'000);
+        std::istringstream input(std::string(data.begin(), data.end()));
+        std::vector<Compressor::EncodedData> chunks;
+        tc.compressStream(input, [&](const Compressor::EncodedData& chunk) { chunks.push_back(chunk); });
+        streamed = tc.decompressFile(chunks);
+    });
+    std::vector<uint8_t> decoded;
+    std::thread decoder([&]() { decoded = tc.decompress(tc.compress(sampleData(150'000))); });
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        EXPECT_EQ(tc.decompress(jobs[i].get()), inputs[i]);
+    }
+    reader.join();
+    decoder.join();
+    EXPECT_EQ(decoded, sampleData(150'000));
+    EXPECT_EQ(streamed, sampleData(120'000));
+
+    // every async job keeps one chunk going even when the others hold the whole budget
+    auto memory = tc.getMetrics().memory;
+    EXPECT_EQ(memory.in_flight, 0u);
+    EXPECT_LE(memory.peak, limit + jobs.size() * 2 * 4096 + 1024);
+}
+
+TEST(ThreadedCompressorTest, QosLimitsWorkersAndRate) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 4096, 4);
+    auto data = sampleData(200'000);
+    auto expected = tc.compress(data);
+    EXPECT_EQ(tc.getMetrics().active_workers, 4u);
+
+    ThreadedCompressor::Qos qos;
+    qos.max_workers = 1;
+    qos.bytes_per_second = 1'000'000;
+    tc.setQos(qos);
+    EXPECT_EQ(tc.getQos().max_workers, 1u);
+    EXPECT_EQ(tc.getMetrics().active_workers, 1u);
+
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(tc.compress(data), expected);
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(150));
+    EXPECT_GT(tc.getMetrics().throttled.count(), 0);
+
+    // small calls would run on this thread, under a limit they go through the pool instead
+    auto small = sampleData(50'000);
+    size_t inline_calls = tc.getMetrics().inline_calls;
+    auto small_archive = tc.compress(small);
+    EXPECT_EQ(tc.decompress(small_archive), small);
+    EXPECT_EQ(tc.getMetrics().inline_calls, inline_calls);
+
+    tc.setQos({});
+    EXPECT_EQ(tc.getMetrics().active_workers, 4u);
+    EXPECT_EQ(tc.decompress(expected), data);
+    EXPECT_EQ(tc.decompress(small_archive), small);
+    EXPECT_EQ(tc.getMetrics().inline_calls, inline_calls + 1);
+}
+
+TEST(ThreadedCompressorTest, QosLiftedWhileAJobRuns) {
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 4096, 2);
+    ThreadedCompressor::Qos qos;
+    qos.max_workers = 1;
+    qos.bytes_per_second = 10'000;   // the job would take 20 seconds at this rate
+    tc.setQos(qos);
+
+    auto data = sampleData(200'000);
+    auto job = tc.compressAsync(data);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_FALSE(job.isDone());
+
+    auto start = std::chrono::steady_clock::now();
+    tc.setQos({});
+    EXPECT_EQ(tc.decompress(job.get()), data);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+}
+
+TEST(ThreadedCompressorTest, QosWorkerPriority) {
+    using Priority = ThreadedCompressor::Priority;
+    ThreadedCompressor tc(std::make_unique<Huffman>(), 4096, 2);
+    auto data = sampleData(100'000);
+
+    // going down always works, going up needs privileges the test may run without
+    for (auto priority : {Priority::Low, Priority::Idle, Priority::Low, Priority::Normal, Priority::Idle, Priority::Normal}) {
+        auto before = tc.getQos().priority;
+        ThreadedCompressor::Qos qos;
+        qos.priority = priority;
+        qos.max_workers = static_cast<size_t>(priority) + 1;
+        try {
+            tc.setQos(qos);
+        }
+        catch (const std::system_error& e) {
+            EXPECT_LT(priority, before);
+            EXPECT_TRUE(e.code()==std::errc::operation_not_permitted || e.code()==std::errc::permission_denied);
+            EXPECT_EQ(tc.getQos().priority, before);
+            EXPECT_EQ(tc.getQos().max_workers, qos.max_workers);
+            continue;
+        }
+        EXPECT_EQ(tc.getQos().priority, priority);
+        EXPECT_EQ(tc.decompress(tc.compress(data)), data);
+    }
+}